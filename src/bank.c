@@ -16,123 +16,752 @@
  *
  */
 #include <config.h>
+#include <bank.h>
 #include <gio/gio.h>
 
-typedef struct _SmipsRaw2Stream SmipsRaw2Stream;
-typedef struct _SmipsRaw2StreamClass SmipsRaw2StreamClass;
-#define __sep "\r\n"
-#define __header "v2.0 raw" __sep
+#if defined (__GNUC__) && (defined (__x86_64__) || defined (__i386__))
+# define HAVE_X86_ENCODERS (1)
+# include <immintrin.h>
+#else // !__GNUC__ || !(__x86_64__ || __i386__)
+# define HAVE_X86_ENCODERS (0)
+#endif // __GNUC__ && (__x86_64__ || __i386__)
+
+typedef struct _SmipsWordStream SmipsWordStream;
+typedef struct _SmipsWordStreamClass SmipsWordStreamClass;
+typedef void (*SmipsHexEncoder) (guint8* out, const guint8* in, gsize words, gsize stride, gboolean swap);
 #define __charset "0123456789abcdef"
-#define __headersz (sizeof (__header) - 1)
-#define __sepsz (sizeof (__sep) - 1)
 #define __align (4)
-#define __wordsz (__align << 1)
-#define __bufsz (__wordsz + __sepsz)
+#define __digits (__align << 1)
+#define __maxlinesz (40)
+#define __stagewords (1024)
+#define __stagesz (__stagewords * __maxlinesz)
+
+/*
+ * Word streams turn every 4-byte word into one line of text.
+ * Whole words are formatted straight into a staging buffer,
+ * which is handed to the parent stream in one go; only a word
+ * split across writes waits in 'albuf'. Subclasses provide the
+ * line layout, plus whatever goes before and after the lines.
+ * Hex digits come from an encoder picked once, at class init
+ *
+ */
 
-struct _SmipsRaw2Stream
+struct _SmipsWordStream
 {
   GBufferedOutputStream parent;
 
   /* private */
-  guint8 albuf [__bufsz];
+  guint8 albuf [__align];
+  guint8 stage [__stagesz];
   gint wrote;
   gint presented;
+  guint64 words;
 };
 
-struct _SmipsRaw2StreamClass
+struct _SmipsWordStreamClass
 {
   GBufferedOutputStreamClass parent;
+  SmipsHexEncoder encode;
+  gsize linesz;
+
+  void (*header) (SmipsWordStream* self, GString* out);
+  void (*format) (SmipsWordStream* self, guint8* out, const guint8* in, gsize words);
+  const gchar* footer;
 };
 
-G_DEFINE_FINAL_TYPE (SmipsRaw2Stream, smips_raw2_stream, G_TYPE_BUFFERED_OUTPUT_STREAM);
+G_DEFINE_ABSTRACT_TYPE (SmipsWordStream, smips_word_stream, G_TYPE_BUFFERED_OUTPUT_STREAM);
 G_STATIC_ASSERT ((G_MAXINT >> 1) > __align);
 
-static gssize smips_raw2_stream_class_write_fn (GOutputStream* pself, const void* _buffer, gsize count, GCancellable* cancellable, GError** error)
-{
-  SmipsRaw2Stream* self = (gpointer) pself;
-  int i, left = __align - self->wrote;
-  const guint8* buffer = _buffer;
-  GError* tmperr = NULL;
-  gsize wrote = 0;
+#define SMIPS_WORD_STREAM_GET_CLASS(obj) (G_TYPE_INSTANCE_GET_CLASS ((obj), smips_word_stream_get_type (), SmipsWordStreamClass))
+#define SMIPS_WORD_STREAM_CLASS(klass) (G_TYPE_CHECK_CLASS_CAST ((klass), smips_word_stream_get_type (), SmipsWordStreamClass))
 
-  if (self->presented == 0)
-  {
-    ++self->presented;
+/*
+ * Encoders write the eight digits of each word at 'stride'
+ * bytes from the previous one, leaving the rest of the line
+ * alone; words are taken in stream order (little-endian) or,
+ * with 'swap', most significant byte first
+ *
+ */
 
-    guint8* __buffer = __header;
-    gsize __size = __headersz;
-    gsize __wrote = 0;
-    gsize got;
+static void encode_scalar (guint8* out, const guint8* in, gsize words, gsize stride, gboolean swap)
+{
+  gsize i, j;
 
-    while (__wrote < __size)
+  for (i = 0; i < words; i++, in += __align, out += stride)
+  {
+    for (j = 0; j < __align; j++)
     {
-      if ((got = G_OUTPUT_STREAM_CLASS (smips_raw2_stream_parent_class)->write_fn (pself, __buffer + __wrote, __size - __wrote, cancellable, &tmperr)) > 0)
-        __wrote += got;
-      else
-      {
-        g_propagate_error (error, tmperr);
-        return -1;
-      }
+      const guint8 value = in [swap ? (__align - 1 - j) : j];
+      out [(j << 1) + 0] = __charset [value >> 4];
+      out [(j << 1) + 1] = __charset [value & 0xf];
     }
   }
+}
+
+#if HAVE_X86_ENCODERS
+
+/*
+ * Nibbles become '0' + n, plus the gap between '9' and
+ * 'a' wherever n > 9; unpacking high and low nibbles
+ * interleaves them back into byte order, so every 64 bits
+ * of the result are one word worth of digits
+ *
+ */
+
+__attribute__ ((target ("sse2")))
+static inline __m128i hexify128 (__m128i nibbles)
+{
+  const __m128i gap = _mm_set1_epi8 ('a' - '0' - 10);
+  const __m128i letters = _mm_and_si128 (_mm_cmpgt_epi8 (nibbles, _mm_set1_epi8 (9)), gap);
+return _mm_add_epi8 (_mm_add_epi8 (nibbles, _mm_set1_epi8 ('0')), letters);
+}
+
+__attribute__ ((target ("sse2")))
+static inline __m128i bswap128 (__m128i bytes)
+{
+  bytes = _mm_or_si128 (_mm_slli_epi16 (bytes, 8), _mm_srli_epi16 (bytes, 8));
+  bytes = _mm_shufflelo_epi16 (bytes, _MM_SHUFFLE (2, 3, 0, 1));
+return _mm_shufflehi_epi16 (bytes, _MM_SHUFFLE (2, 3, 0, 1));
+}
+
+__attribute__ ((target ("sse2")))
+static inline void store128 (guint8* out, gsize stride, __m128i digits)
+{
+  _mm_storel_epi64 ((__m128i*) out, digits);
+  _mm_storel_epi64 ((__m128i*) (out + stride), _mm_srli_si128 (digits, 8));
+}
+
+__attribute__ ((target ("sse2")))
+static void encode_sse2 (guint8* out, const guint8* in, gsize words, gsize stride, gboolean swap)
+{
+  const __m128i mask = _mm_set1_epi8 (0xf);
+  gsize i;
+
+  for (i = 0; i + 4 <= words; i += 4, in += 4 * __align, out += 4 * stride)
+  {
+    const __m128i loaded = _mm_loadu_si128 ((const __m128i*) in);
+    const __m128i bytes = swap ? bswap128 (loaded) : loaded;
+    const __m128i hi = hexify128 (_mm_and_si128 (_mm_srli_epi16 (bytes, 4), mask));
+    const __m128i lo = hexify128 (_mm_and_si128 (bytes, mask));
+
+    store128 (out + 0 * stride, stride, _mm_unpacklo_epi8 (hi, lo));
+    store128 (out + 2 * stride, stride, _mm_unpackhi_epi8 (hi, lo));
+  }
+
+  encode_scalar (out, in, words - i, stride, swap);
+}
+
+__attribute__ ((target ("avx2")))
+static inline __m256i hexify256 (__m256i nibbles)
+{
+  const __m256i gap = _mm256_set1_epi8 ('a' - '0' - 10);
+  const __m256i letters = _mm256_and_si256 (_mm256_cmpgt_epi8 (nibbles, _mm256_set1_epi8 (9)), gap);
+return _mm256_add_epi8 (_mm256_add_epi8 (nibbles, _mm256_set1_epi8 ('0')), letters);
+}
 
-  do
+__attribute__ ((target ("avx2")))
+static void encode_avx2 (guint8* out, const guint8* in, gsize words, gsize stride, gboolean swap)
+{
+  const __m256i mask = _mm256_set1_epi8 (0xf);
+  const __m256i order = _mm256_setr_epi8 (3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+                                          3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+  gsize i;
+
+  for (i = 0; i + 8 <= words; i += 8, in += 8 * __align, out += 8 * stride)
   {
-    left = MIN (count, left);
+    const __m256i loaded = _mm256_loadu_si256 ((const __m256i*) in);
+    const __m256i bytes = swap ? _mm256_shuffle_epi8 (loaded, order) : loaded;
+    const __m256i hi = hexify256 (_mm256_and_si256 (_mm256_srli_epi16 (bytes, 4), mask));
+    const __m256i lo = hexify256 (_mm256_and_si256 (bytes, mask));
+
+    /* unpacking works per 128-bit lane: words 0-3 low, 4-7 high */
+    const __m256i first = _mm256_unpacklo_epi8 (hi, lo);
+    const __m256i second = _mm256_unpackhi_epi8 (hi, lo);
+
+    store128 (out + 0 * stride, stride, _mm256_castsi256_si128 (first));
+    store128 (out + 2 * stride, stride, _mm256_castsi256_si128 (second));
+    store128 (out + 4 * stride, stride, _mm256_extracti128_si256 (first, 1));
+    store128 (out + 6 * stride, stride, _mm256_extracti128_si256 (second, 1));
+  }
+
+  encode_sse2 (out, in, words - i, stride, swap);
+}
 
-    for (i = 0; i < left; i++)
+#endif // HAVE_X86_ENCODERS
+
+static void separate (guint8* out, gsize words, gsize stride, gsize at, const gchar* text)
+{
+  const gsize length = strlen (text);
+  gsize i;
+
+  for (i = 0; i < words; i++, out += stride)
+    memcpy (out + at, text, length);
+}
+
+static gboolean write_all (GOutputStream* pself, const guint8* buffer, gsize size, GCancellable* cancellable, GError** error)
+{
+  GOutputStreamClass* klass = G_OUTPUT_STREAM_CLASS (smips_word_stream_parent_class);
+  gssize got;
+
+  while (size > 0)
+  {
+    if ((got = klass->write_fn (pself, buffer, size, cancellable, error)) < 0)
+      return FALSE;
+    else if (got == 0)
     {
-      guint8 value = *buffer++;
-      self->albuf [self->wrote + (i << 1) + 0] = __charset [value >> 4];
-      self->albuf [self->wrote + (i << 1) + 1] = __charset [value & 0xf];
+      g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_FAILED, "Write returned zero bytes");
+      return FALSE;
     }
 
-    self->wrote += left;
+    buffer += got;
+    size -= got;
+  }
+return TRUE;
+}
+
+static gboolean present (SmipsWordStream* self, GCancellable* cancellable, GError** error)
+{
+  SmipsWordStreamClass* klass = SMIPS_WORD_STREAM_GET_CLASS (self);
+  GString* header = NULL;
+  gboolean done;
+
+  if (self->presented++ > 0 || klass->header == NULL)
+    return TRUE;
+
+  header = g_string_sized_new (64);
+  klass->header (self, header);
+  done = write_all (G_OUTPUT_STREAM (self), (const guint8*) header->str, header->len, cancellable, error);
+  g_string_free (header, TRUE);
+return done;
+}
+
+static gssize smips_word_stream_class_write_fn (GOutputStream* pself, const void* _buffer, gsize count, GCancellable* cancellable, GError** error)
+{
+  SmipsWordStream* self = (gpointer) pself;
+  SmipsWordStreamClass* klass = SMIPS_WORD_STREAM_GET_CLASS (self);
+  const gsize capacity = (__stagesz / klass->linesz) * klass->linesz;
+  const guint8* buffer = _buffer;
+  gsize left = count;
+  gsize staged = 0;
+  gsize words;
+
+  if (!present (self, cancellable, error))
+    return -1;
+
+  /* complete the word a previous write left halfway */
+  while (self->wrote > 0 && left > 0)
+  {
+    self->albuf [self->wrote++] = *buffer++;
+    left--;
 
     if (self->wrote == __align)
     {
-      guint8* __buffer = self->albuf;
-      gsize __size = G_SIZEOF_MEMBER (SmipsRaw2Stream, albuf);
-      gsize __wrote = 0;
-      gsize got;
-
-      memcpy (& self->albuf [__wordsz], __sep, __sepsz);
+      klass->format (self, self->stage, self->albuf, 1);
+      staged = klass->linesz;
       self->wrote = 0;
+      self->words++;
+    }
+  }
+
+  while (left >= __align)
+  {
+    words = MIN (left / __align, (capacity - staged) / klass->linesz);
+    klass->format (self, self->stage + staged, buffer, words);
+
+    staged += words * klass->linesz;
+    buffer += words * __align;
+    left -= words * __align;
+    self->words += words;
 
-      while (__wrote < __size)
-      {
-        if ((got = G_OUTPUT_STREAM_CLASS (smips_raw2_stream_parent_class)->write_fn (pself, __buffer + __wrote, __size - __wrote, cancellable, &tmperr)) > 0)
-          __wrote += got;
-        else
-        {
-          g_propagate_error (error, tmperr);
-          return -1;
-        }
-      }
+    if (staged == capacity)
+    {
+      if (!write_all (pself, self->stage, staged, cancellable, error))
+        return -1;
+      staged = 0;
     }
+  }
 
-    wrote += left;
-    count -= left;
+  if (staged > 0 && !write_all (pself, self->stage, staged, cancellable, error))
+    return -1;
+
+  while (left > 0)
+  {
+    self->albuf [self->wrote++] = *buffer++;
+    left--;
   }
-  while (count > 0);
-return wrote;
+return count;
 }
 
-static void smips_raw2_stream_class_constructed (GObject* pself)
+/*
+ * A trailing partial word is zero-padded up to a full
+ * line rather than dropped, same as banks pad gaps
+ *
+ */
+
+static gboolean finish (SmipsWordStream* self, GCancellable* cancellable, GError** error)
 {
-  SmipsRaw2Stream* self = (gpointer) pself;
-G_OBJECT_CLASS (smips_raw2_stream_parent_class)->constructed (pself);
+  SmipsWordStreamClass* klass = SMIPS_WORD_STREAM_GET_CLASS (self);
+  GOutputStream* pself = G_OUTPUT_STREAM (self);
+  const gchar* footer = klass->footer;
+
+  if (!present (self, cancellable, error))
+    return FALSE;
+
+  if (self->wrote > 0)
+  {
+    memset (self->albuf + self->wrote, 0, __align - self->wrote);
+    klass->format (self, self->stage, self->albuf, 1);
+    self->wrote = 0;
+    self->words++;
+
+    if (!write_all (pself, self->stage, klass->linesz, cancellable, error))
+      return FALSE;
+  }
+
+  if (footer != NULL && !write_all (pself, (const guint8*) footer, strlen (footer), cancellable, error))
+    return FALSE;
+return TRUE;
+}
+
+static gboolean smips_word_stream_class_close_fn (GOutputStream* pself, GCancellable* cancellable, GError** error)
+{
+  if (!finish ((gpointer) pself, cancellable, error))
+    return FALSE;
+return G_OUTPUT_STREAM_CLASS (smips_word_stream_parent_class)->close_fn (pself, cancellable, error);
+}
+
+static void smips_word_stream_class_init (SmipsWordStreamClass* klass)
+{
+  GOutputStreamClass* sclass = G_OUTPUT_STREAM_CLASS (klass);
+
+  sclass->write_fn = smips_word_stream_class_write_fn;
+  sclass->close_fn = smips_word_stream_class_close_fn;
+  klass->encode = encode_scalar;
+
+#if HAVE_X86_ENCODERS
+  __builtin_cpu_init ();
+
+  if (__builtin_cpu_supports ("avx2"))
+    klass->encode = encode_avx2;
+  else if (__builtin_cpu_supports ("sse2"))
+    klass->encode = encode_sse2;
+#endif // HAVE_X86_ENCODERS
+}
+
+static void smips_word_stream_init (SmipsWordStream* self)
+{
+}
+
+/*
+ * Word stream flavours, each one a final type:
+ *
+ * +------+--------------------------+-----------+--------------+
+ * | Type | Line                     | Words     | For          |
+ * +------+--------------------------+-----------+--------------+
+ * | raw2 | 'hhhhhhhh\r\n'           | as stored | Logisim v2.0 |
+ * | memh | 'hhhhhhhh\n'             | MSB first | $readmemh    |
+ * | memb | 32 binary digits, '\n'   | MSB first | $readmemb    |
+ * | coe  | 'hhhhhhhh\n'             | MSB first | Xilinx COE   |
+ * | mif  | 'aaaaaaaa : hhhhhhhh;\n' | MSB first | Intel MIF    |
+ * +------+--------------------------+-----------+--------------+
+ *
+ */
+
+#define word_stream(Name,name) \
+  typedef struct _Smips##Name##Stream Smips##Name##Stream; \
+  typedef struct _Smips##Name##StreamClass Smips##Name##StreamClass; \
+  struct _Smips##Name##Stream { SmipsWordStream parent; }; \
+  struct _Smips##Name##StreamClass { SmipsWordStreamClass parent; }; \
+  G_DEFINE_FINAL_TYPE (Smips##Name##Stream, smips_##name##_stream, smips_word_stream_get_type ()); \
+  static void smips_##name##_stream_init (Smips##Name##Stream* self) { }
+
+word_stream (Raw2, raw2)
+word_stream (Memh, memh)
+word_stream (Memb, memb)
+word_stream (Coe, coe)
+#undef word_stream
+
+static void raw2_header (SmipsWordStream* self, GString* out)
+{
+  g_string_append (out, "v2.0 raw\r\n");
+}
+
+static void raw2_format (SmipsWordStream* self, guint8* out, const guint8* in, gsize words)
+{
+  SMIPS_WORD_STREAM_GET_CLASS (self)->encode (out, in, words, __digits + 2, FALSE);
+  separate (out, words, __digits + 2, __digits, "\r\n");
 }
 
 static void smips_raw2_stream_class_init (SmipsRaw2StreamClass* klass)
+{
+  SmipsWordStreamClass* wclass = SMIPS_WORD_STREAM_CLASS (klass);
+
+  wclass->linesz = __digits + 2;
+  wclass->header = raw2_header;
+  wclass->format = raw2_format;
+}
+
+static void memh_format (SmipsWordStream* self, guint8* out, const guint8* in, gsize words)
+{
+  SMIPS_WORD_STREAM_GET_CLASS (self)->encode (out, in, words, __digits + 1, TRUE);
+  separate (out, words, __digits + 1, __digits, "\n");
+}
+
+static void smips_memh_stream_class_init (SmipsMemhStreamClass* klass)
+{
+  SmipsWordStreamClass* wclass = SMIPS_WORD_STREAM_CLASS (klass);
+
+  wclass->linesz = __digits + 1;
+  wclass->format = memh_format;
+}
+
+static void memb_format (SmipsWordStream* self, guint8* out, const guint8* in, gsize words)
+{
+  static const gchar nibbles [16][4] =
+  {
+    "0000", "0001", "0010", "0011", "0100", "0101", "0110", "0111",
+    "1000", "1001", "1010", "1011", "1100", "1101", "1110", "1111",
+  };
+
+  gsize i;
+  int j;
+
+  for (i = 0; i < words; i++, in += __align, out += 33)
+  {
+    for (j = 0; j < __align; j++)
+    {
+      const guint8 value = in [__align - 1 - j];
+      memcpy (out + (j << 3) + 0, nibbles [value >> 4], 4);
+      memcpy (out + (j << 3) + 4, nibbles [value & 0xf], 4);
+    }
+
+    out [32] = '\n';
+  }
+}
+
+static void smips_memb_stream_class_init (SmipsMembStreamClass* klass)
+{
+  SmipsWordStreamClass* wclass = SMIPS_WORD_STREAM_CLASS (klass);
+
+  wclass->linesz = 33;
+  wclass->format = memb_format;
+}
+
+static void coe_header (SmipsWordStream* self, GString* out)
+{
+  g_string_append (out, "memory_initialization_radix=16;\n");
+  g_string_append (out, "memory_initialization_vector=\n");
+}
+
+static void smips_coe_stream_class_init (SmipsCoeStreamClass* klass)
+{
+  SmipsWordStreamClass* wclass = SMIPS_WORD_STREAM_CLASS (klass);
+
+  wclass->linesz = __digits + 1;
+  wclass->header = coe_header;
+  wclass->format = memh_format;
+  wclass->footer = ";\n";
+}
+
+/*
+ * MIF wants the memory depth before any content, which is
+ * not known until close; the header carries a fixed-width
+ * placeholder which close_fn overwrites by seeking back,
+ * so words stream out as they come like any other format
+ *
+ */
+
+typedef struct _SmipsMifStream SmipsMifStream;
+typedef struct _SmipsMifStreamClass SmipsMifStreamClass;
+#define __depthat (8)
+#define __depthwidth (10)
+
+struct _SmipsMifStream
+{
+  SmipsWordStream parent;
+
+  /* private */
+  goffset origin;
+};
+
+struct _SmipsMifStreamClass
+{
+  SmipsWordStreamClass parent;
+};
+
+G_DEFINE_FINAL_TYPE (SmipsMifStream, smips_mif_stream, smips_word_stream_get_type ());
+
+static void mif_header (SmipsWordStream* pself, GString* out)
+{
+  SmipsMifStream* self = (gpointer) pself;
+
+  self->origin = g_seekable_tell (G_SEEKABLE (self));
+
+  g_string_append_printf (out, "DEPTH = %0*u;\n", __depthwidth, 0);
+  g_string_append (out, "WIDTH = 32;\n");
+  g_string_append (out, "ADDRESS_RADIX = HEX;\n");
+  g_string_append (out, "DATA_RADIX = HEX;\n");
+  g_string_append (out, "CONTENT\n");
+  g_string_append (out, "BEGIN\n");
+}
+
+static void mif_format (SmipsWordStream* self, guint8* out, const guint8* in, gsize words)
+{
+  const gsize stride = 11 + __digits + 2;
+  gsize i;
+
+  for (i = 0; i < words; i++)
+  {
+    const guint32 address = GUINT32_TO_LE ((guint32) (self->words + i));
+    encode_scalar (out + i * stride, (const guint8*) &address, 1, stride, TRUE);
+  }
+
+  SMIPS_WORD_STREAM_GET_CLASS (self)->encode (out + 11, in, words, stride, TRUE);
+  separate (out, words, stride, __digits, " : ");
+  separate (out, words, stride, 11 + __digits, ";\n");
+}
+
+static gboolean smips_mif_stream_class_close_fn (GOutputStream* pself, GCancellable* cancellable, GError** error)
+{
+  SmipsMifStream* self = (gpointer) pself;
+  SmipsWordStream* wself = (gpointer) pself;
+  static const guint8 zeroes [__align] = { 0, };
+  gchar depth [__depthwidth + 1];
+
+  /* a memory is never empty, an empty image is one zero word */
+  if (wself->words == 0 && wself->wrote == 0)
+  {
+    if (smips_word_stream_class_write_fn (pself, zeroes, __align, cancellable, error) < 0)
+      return FALSE;
+  }
+
+  if (!finish (wself, cancellable, error))
+    return FALSE;
+
+  if (wself->words > G_MAXUINT32)
+  {
+    g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Image too large for MIF");
+    return FALSE;
+  }
+
+  g_snprintf (depth, sizeof (depth), "%0*u", __depthwidth, (guint) wself->words);
+
+  if (!g_seekable_seek (G_SEEKABLE (self), self->origin + __depthat, G_SEEK_SET, cancellable, error))
+    return FALSE;
+  if (!write_all (pself, (const guint8*) depth, __depthwidth, cancellable, error))
+    return FALSE;
+return G_OUTPUT_STREAM_CLASS (smips_word_stream_parent_class)->close_fn (pself, cancellable, error);
+}
+
+static void smips_mif_stream_class_init (SmipsMifStreamClass* klass)
+{
+  GOutputStreamClass* sclass = G_OUTPUT_STREAM_CLASS (klass);
+  SmipsWordStreamClass* wclass = SMIPS_WORD_STREAM_CLASS (klass);
+
+  sclass->close_fn = smips_mif_stream_class_close_fn;
+  wclass->linesz = 11 + __digits + 2;
+  wclass->header = mif_header;
+  wclass->format = mif_format;
+  wclass->footer = "END;\n";
+}
+
+static void smips_mif_stream_init (SmipsMifStream* self)
+{
+}
+
+/*
+ * ELF images are kept in memory until the stream is closed,
+ * since headers need the image and symbol table sizes; the
+ * image becomes a single loadable .text section at address
+ * zero, words stay little-endian as written
+ *
+ */
+
+typedef struct _SmipsElfStream SmipsElfStream;
+typedef struct _SmipsElfStreamClass SmipsElfStreamClass;
+#define __ehdrsz (52)
+#define __phdrsz (32)
+#define __shdrsz (40)
+#define __symsz (16)
+#define __shstrtab "\0.text\0.symtab\0.strtab\0.shstrtab\0"
+#define __shstrtabsz (sizeof (__shstrtab) - 1)
+#define __wordalign(n) (((n) + (__align - 1)) & ~(__align - 1))
+
+enum
+{
+  SECTION_NULL,
+  SECTION_TEXT,
+  SECTION_SYMTAB,
+  SECTION_STRTAB,
+  SECTION_SHSTRTAB,
+  SECTION_COUNT,
+};
+
+struct _SmipsElfStream
+{
+  GFilterOutputStream parent;
+
+  /* private */
+  GByteArray* image;
+  GByteArray* symtab;
+  GByteArray* strtab;
+};
+
+struct _SmipsElfStreamClass
+{
+  GFilterOutputStreamClass parent;
+};
+
+G_DEFINE_FINAL_TYPE (SmipsElfStream, smips_elf_stream, G_TYPE_FILTER_OUTPUT_STREAM);
+
+static void put8 (GByteArray* out, guint8 value)
+{
+  g_byte_array_append (out, &value, 1);
+}
+
+static void put16 (GByteArray* out, guint16 value)
+{
+  value = GUINT16_TO_LE (value);
+  g_byte_array_append (out, (const guint8*) &value, sizeof (value));
+}
+
+static void put32 (GByteArray* out, guint32 value)
+{
+  value = GUINT32_TO_LE (value);
+  g_byte_array_append (out, (const guint8*) &value, sizeof (value));
+}
+
+static void putsection (GByteArray* out, guint name, guint type, guint flags, gsize offset, gsize size, guint link, guint info, guint align, guint entsize)
+{
+  put32 (out, name);
+  put32 (out, type);
+  put32 (out, flags);
+  put32 (out, 0);
+  put32 (out, (guint32) offset);
+  put32 (out, (guint32) size);
+  put32 (out, link);
+  put32 (out, info);
+  put32 (out, align);
+  put32 (out, entsize);
+}
+
+void smips_elf_stream_add_symbol (GOutputStream* stream, const gchar* name, guint32 value)
+{
+  SmipsElfStream* self = (gpointer) stream;
+  g_return_if_fail (G_TYPE_CHECK_INSTANCE_TYPE (stream, smips_elf_stream_get_type ()));
+
+  put32 (self->symtab, self->strtab->len);
+  put32 (self->symtab, value);
+  put32 (self->symtab, 0);
+  put8 (self->symtab, 0x10 /* STB_GLOBAL, STT_NOTYPE */);
+  put8 (self->symtab, 0);
+  put16 (self->symtab, SECTION_TEXT);
+  g_byte_array_append (self->strtab, (const guint8*) name, strlen (name) + 1);
+}
+
+static gssize smips_elf_stream_class_write_fn (GOutputStream* pself, const void* buffer, gsize count, GCancellable* cancellable, GError** error)
+{
+  SmipsElfStream* self = (gpointer) pself;
+  g_byte_array_append (self->image, buffer, count);
+return count;
+}
+
+static gboolean smips_elf_stream_class_close_fn (GOutputStream* pself, GCancellable* cancellable, GError** error)
+{
+  SmipsElfStream* self = (gpointer) pself;
+  GOutputStream* base = g_filter_output_stream_get_base_stream (G_FILTER_OUTPUT_STREAM (pself));
+  GByteArray* head = g_byte_array_new ();
+  GByteArray* tail = g_byte_array_new ();
+  static const guint8 zeroes [__align] = { 0, };
+  const gsize text = __ehdrsz + __phdrsz;
+  const gsize symtab = __wordalign (text + self->image->len);
+  const gsize strtab = symtab + self->symtab->len;
+  const gsize shstrtab = strtab + self->strtab->len;
+  const gsize sections = __wordalign (shstrtab + __shstrtabsz);
+  gboolean done;
+
+  /* ELF header */
+  g_byte_array_append (head, (const guint8*) "\177ELF", 4);
+  put8 (head, 1 /* ELFCLASS32 */);
+  put8 (head, 1 /* ELFDATA2LSB */);
+  put8 (head, 1 /* EV_CURRENT */);
+  g_byte_array_append (head, zeroes, __align);
+  g_byte_array_append (head, zeroes, __align);
+  g_byte_array_append (head, zeroes, 1);
+  put16 (head, 2 /* ET_EXEC */);
+  put16 (head, 8 /* EM_MIPS */);
+  put32 (head, 1 /* EV_CURRENT */);
+  put32 (head, 0);
+  put32 (head, __ehdrsz);
+  put32 (head, (guint32) sections);
+  put32 (head, 0);
+  put16 (head, __ehdrsz);
+  put16 (head, __phdrsz);
+  put16 (head, 1);
+  put16 (head, __shdrsz);
+  put16 (head, SECTION_COUNT);
+  put16 (head, SECTION_SHSTRTAB);
+
+  /* PT_LOAD, readable and executable */
+  put32 (head, 1);
+  put32 (head, (guint32) text);
+  put32 (head, 0);
+  put32 (head, 0);
+  put32 (head, self->image->len);
+  put32 (head, self->image->len);
+  put32 (head, 4 | 1);
+  put32 (head, __align);
+
+  g_byte_array_append (tail, (const guint8*) __shstrtab, __shstrtabsz);
+  g_byte_array_append (tail, zeroes, sections - (shstrtab + __shstrtabsz));
+  putsection (tail, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+  putsection (tail, 1, 1 /* PROGBITS */, 2 | 4 /* ALLOC, EXECINSTR */, text, self->image->len, 0, 0, __align, 0);
+  putsection (tail, 7, 2 /* SYMTAB */, 0, symtab, self->symtab->len, SECTION_STRTAB, 1, __align, __symsz);
+  putsection (tail, 15, 3 /* STRTAB */, 0, strtab, self->strtab->len, 0, 0, 1, 0);
+  putsection (tail, 23, 3 /* STRTAB */, 0, shstrtab, __shstrtabsz, 0, 0, 1, 0);
+
+  done = g_output_stream_write_all (base, head->data, head->len, NULL, cancellable, error)
+      && g_output_stream_write_all (base, self->image->data, self->image->len, NULL, cancellable, error)
+      && g_output_stream_write_all (base, zeroes, symtab - (text + self->image->len), NULL, cancellable, error)
+      && g_output_stream_write_all (base, self->symtab->data, self->symtab->len, NULL, cancellable, error)
+      && g_output_stream_write_all (base, self->strtab->data, self->strtab->len, NULL, cancellable, error)
+      && g_output_stream_write_all (base, tail->data, tail->len, NULL, cancellable, error);
+
+  g_byte_array_unref (head);
+  g_byte_array_unref (tail);
+
+  if (!done)
+    return FALSE;
+return G_OUTPUT_STREAM_CLASS (smips_elf_stream_parent_class)->close_fn (pself, cancellable, error);
+}
+
+static void smips_elf_stream_class_finalize (GObject* pself)
+{
+  SmipsElfStream* self = (gpointer) pself;
+  g_byte_array_unref (self->image);
+  g_byte_array_unref (self->symtab);
+  g_byte_array_unref (self->strtab);
+G_OBJECT_CLASS (smips_elf_stream_parent_class)->finalize (pself);
+}
+
+static void smips_elf_stream_class_init (SmipsElfStreamClass* klass)
 {
   GOutputStreamClass* sclass = G_OUTPUT_STREAM_CLASS (klass);
   GObjectClass* oclass = G_OBJECT_CLASS (klass);
 
-  sclass->write_fn = smips_raw2_stream_class_write_fn;
-  oclass->constructed = smips_raw2_stream_class_constructed;
+  sclass->write_fn = smips_elf_stream_class_write_fn;
+  sclass->close_fn = smips_elf_stream_class_close_fn;
+  oclass->finalize = smips_elf_stream_class_finalize;
 }
 
-static void smips_raw2_stream_init (SmipsRaw2Stream* self)
+static void smips_elf_stream_init (SmipsElfStream* self)
 {
+  static const guint8 null [__symsz] = { 0, };
+
+  self->image = g_byte_array_new ();
+  self->symtab = g_byte_array_new ();
+  self->strtab = g_byte_array_new ();
+
+  g_byte_array_append (self->symtab, null, __symsz);
+  g_byte_array_append (self->strtab, null, 1);
 }
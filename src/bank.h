@@ -17,13 +17,19 @@
  */
 #ifndef __SMIPS_BANK__
 #define __SMIPS_BANK__ 1
-#include <glib-object.h>
+#include <gio/gio.h>
 
 #if __cplusplus
 extern "C" {
 #endif // __cplusplus
 
 G_GNUC_INTERNAL GType smips_raw2_stream_get_type (void) G_GNUC_CONST;
+G_GNUC_INTERNAL GType smips_memh_stream_get_type (void) G_GNUC_CONST;
+G_GNUC_INTERNAL GType smips_memb_stream_get_type (void) G_GNUC_CONST;
+G_GNUC_INTERNAL GType smips_coe_stream_get_type (void) G_GNUC_CONST;
+G_GNUC_INTERNAL GType smips_mif_stream_get_type (void) G_GNUC_CONST;
+G_GNUC_INTERNAL GType smips_elf_stream_get_type (void) G_GNUC_CONST;
+G_GNUC_INTERNAL void smips_elf_stream_add_symbol (GOutputStream* stream, const gchar* name, guint32 value);
 
 #if __cplusplus
 }
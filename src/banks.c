@@ -17,6 +17,7 @@
  */
 #include <config.h>
 #include <bank.h>
+#include <blocks.h>
 #include <gio/gio.h>
 #include <gmodule.h>
 #include <lua.h>
@@ -27,6 +28,8 @@
 typedef struct _SmipsBank SmipsBank;
 #define _g_object_unref0(var) ((var == NULL) ? NULL : (var = (g_object_unref (var), NULL)))
 #define META "SmipsBank"
+#define CHUNK (65536)
+#define STRIPE (4096)
 
 struct _SmipsBank
 {
@@ -36,24 +39,79 @@ struct _SmipsBank
     GSeekable* seekable;
     GOutputStream* stream;
   };
+
+  GFile* created;
 };
 
+/*
+ * Banks replace their file only when closed. Existing files
+ * are replaced through a temporary one which GIO drops when
+ * closed cancelled, so a bank collected still open leaves
+ * them alone; discard () also deletes a file the bank itself
+ * created. Callers discard explicitly on failure, collection
+ * time is never relied upon to delete anything
+ *
+ */
+
+static void cancelclose (SmipsBank* self)
+{
+  GCancellable* cancellable = g_cancellable_new ();
+  GOutputStream* base = g_filter_output_stream_get_base_stream (G_FILTER_OUTPUT_STREAM (self->stream));
+
+  g_cancellable_cancel (cancellable);
+  g_output_stream_close (base, cancellable, NULL);
+  g_output_stream_close (self->stream, cancellable, NULL);
+  g_object_unref (cancellable);
+}
+
 static int __gc (lua_State* L)
 {
   SmipsBank* self = luaL_checkudata (L, 1, META);
+
+  if (self->object != NULL && !g_output_stream_is_closed (self->stream))
+    cancelclose (self);
+
+  _g_object_unref0 (self->created);
   g_clear_object (&self->object);
 return 0;
 }
 
+static const gchar* formats [] = { "raw", "bin", "elf", "readmemh", "readmemb", "coe", "mif", NULL, };
+
+enum
+{
+  FORMAT_RAW,
+  FORMAT_BIN,
+  FORMAT_ELF,
+  FORMAT_READMEMH,
+  FORMAT_READMEMB,
+  FORMAT_COE,
+  FORMAT_MIF,
+};
+
 static int _new (lua_State* L)
 {
   GError* tmperr = NULL;
   GFile* file = NULL;
   GFileOutputStream* stream = NULL;
-  const GType gtype = smips_raw2_stream_get_type ();
   const gsize sz = sizeof (SmipsBank);
   const gchar* name = luaL_checkstring (L, 1);
-  SmipsBank* self = lua_newuserdata (L, sz);
+  const gchar* format = luaL_optstring (L, 2, formats [FORMAT_RAW]);
+  SmipsBank* self = NULL;
+  int i;
+
+  for (i = 0; formats [i] != NULL; i++)
+  {
+    if (g_str_equal (formats [i], format))
+      break;
+  }
+
+  if (formats [i] == NULL)
+    _smips_log_lerror (L, 1, lua_pushfstring (L, "Unknown output format '%s'", format));
+
+  self = lua_newuserdata (L, sz);
+  self->object = NULL;
+  self->created = NULL;
 #if LUA_VERSION_NUM >= 502
   luaL_setmetatable (L, META);
 #else // LUA_VERSION_NUM < 502
@@ -62,13 +120,38 @@ static int _new (lua_State* L)
 #endif // LUA_VERSION_NUM
 
   file = g_file_new_for_commandline_arg (name);
-  stream = g_file_replace (file, NULL, FALSE, 0, NULL, &tmperr);
+
+  /* creating first tells, race free, whether the file is ours */
+  if ((stream = g_file_create (file, 0, NULL, &tmperr)) != NULL)
+    self->created = g_object_ref (file);
+  else if (g_error_matches (tmperr, G_IO_ERROR, G_IO_ERROR_EXISTS))
+  {
+    g_clear_error (&tmperr);
+    stream = g_file_replace (file, NULL, FALSE, 0, NULL, &tmperr);
+  }
+
   _g_object_unref0 (file);
 
-  if (G_UNLIKELY (tmperr == NULL))
+  if (G_LIKELY (tmperr == NULL))
   {
-    self->object = g_object_new (gtype, "base-stream", stream, NULL);
-                  g_object_unref (stream);
+    GType gtype = G_TYPE_INVALID;
+
+    switch (i)
+    {
+      case FORMAT_RAW: gtype = smips_raw2_stream_get_type (); break;
+      case FORMAT_ELF: gtype = smips_elf_stream_get_type (); break;
+      case FORMAT_READMEMH: gtype = smips_memh_stream_get_type (); break;
+      case FORMAT_READMEMB: gtype = smips_memb_stream_get_type (); break;
+      case FORMAT_COE: gtype = smips_coe_stream_get_type (); break;
+      case FORMAT_MIF: gtype = smips_mif_stream_get_type (); break;
+    }
+
+    if (i == FORMAT_BIN)
+      self->object = g_buffered_output_stream_new (G_OUTPUT_STREAM (stream));
+    else
+      self->object = g_object_new (gtype, "base-stream", stream, NULL);
+
+    g_object_unref (stream);
   }
   else
   {
@@ -93,26 +176,78 @@ static int _new (lua_State* L)
 return 1;
 }
 
+static int _discard (lua_State* L)
+{
+  SmipsBank* self = luaL_checkudata (L, 1, META);
+
+  if (!g_output_stream_is_closed (self->stream))
+  {
+    cancelclose (self);
+
+    if (self->created != NULL)
+      g_file_delete (self->created, NULL, NULL);
+  }
+
+  _g_object_unref0 (self->created);
+return 0;
+}
+
 static int _close (lua_State* L)
 {
   SmipsBank* self = luaL_checkudata (L, 1, META);
   GError* tmperr = NULL;
 
   g_output_stream_close (self->stream, NULL, &tmperr);
+  _g_object_unref0 (self->created);
 
   if (G_UNLIKELY (tmperr != NULL))
     _smips_log_gerror (L, 0, tmperr);
 return 0;
 }
 
+/*
+ * Only formats carrying a symbol table take any
+ * notice, names map to byte addresses
+ *
+ */
+
+static int symbols (lua_State* L)
+{
+  const SmipsBank* self = luaL_checkudata (L, 1, META);
+  const GType gtype = smips_elf_stream_get_type ();
+
+  luaL_checktype (L, 2, LUA_TTABLE);
+
+  if (G_TYPE_CHECK_INSTANCE_TYPE (self->object, gtype))
+  {
+    lua_pushnil (L);
+
+    while (lua_next (L, 2))
+    {
+      if (lua_type (L, -2) == LUA_TSTRING && lua_type (L, -1) == LUA_TNUMBER)
+        smips_elf_stream_add_symbol (self->stream, lua_tostring (L, -2), (guint32) lua_tointeger (L, -1));
+      lua_pop (L, 1);
+    }
+  }
+return 0;
+}
+
 static int zero (lua_State* L)
 {
+  static const guint8 zeroes [4096] = { 0, };
   const SmipsBank* self = luaL_checkudata (L, 1, META);
-  const guint size = luaL_checkinteger (L, 2);
+  const lua_Integer size = luaL_checkinteger (L, 2);
   GError* tmperr = NULL;
+  gsize left, chunk;
+
+  luaL_argcheck (L, size >= 0 && size % 4 == 0, 2, "expected a word aligned size");
 
-  g_assert (size % 4 == 0);
-  g_seekable_seek (self->seekable, size, G_SEEK_CUR, NULL, &tmperr);
+  /* banks are text streams, gaps can not be seeked over */
+  for (left = (gsize) size; left > 0 && tmperr == NULL; left -= chunk)
+  {
+    chunk = MIN (left, sizeof (zeroes));
+    g_output_stream_write_all (self->stream, zeroes, chunk, NULL, NULL, &tmperr);
+  }
 
   if (G_UNLIKELY (tmperr != NULL))
     _smips_log_gerror (L, 0, tmperr);
@@ -175,10 +310,130 @@ static int emits (lua_State* L)
 return 0;
 }
 
+/*
+ * Whole blocks are read straight off their columns and
+ * written in large chunks, one call for the whole image
+ *
+ */
+
+static int emitblock (lua_State* L)
+{
+  const SmipsBank* self = luaL_checkudata (L, 1, META);
+  const SmipsBlock* block = _smips_block_check (L, 2);
+  guint8* buffer = g_malloc (CHUNK);
+  SmipsBlockReader reader;
+  GError* tmperr = NULL;
+  gsize got;
+
+  _smips_block_reader_init (&reader, block);
+
+  while (tmperr == NULL && (got = _smips_block_read (&reader, buffer, CHUNK)) > 0)
+    g_output_stream_write_all (self->stream, buffer, got, NULL, NULL, &tmperr);
+
+  g_free (buffer);
+
+  if (G_UNLIKELY (tmperr != NULL))
+    _smips_log_gerror (L, 0, tmperr);
+return 0;
+}
+
+static gboolean flushstripe (GOutputStream* stream, guint8* buffer, gsize* fill, GError** error)
+{
+  gboolean done = g_output_stream_write_all (stream, buffer, *fill, NULL, NULL, error);
+return (*fill = 0, done);
+}
+
+/*
+ * Deals the words of a block round-robin over a list of
+ * banks, starting at bank 'next'; returns the bank the
+ * following word would go to
+ *
+ */
+
+static int stripe (lua_State* L)
+{
+  const SmipsBlock* block = _smips_block_check (L, 1);
+  GOutputStream** streams = NULL;
+  SmipsBlockReader reader;
+  GError* tmperr = NULL;
+  guint8 *buffer, *stage;
+  gsize* fills = NULL;
+  gsize count, got, at;
+  lua_Integer next;
+  guint i, j;
+
+  luaL_checktype (L, 2, LUA_TTABLE);
+#if LUA_VERSION_NUM >= 502
+  count = (gsize) lua_rawlen (L, 2);
+#else // LUA_VERSION_NUM < 502
+  count = (gsize) lua_objlen (L, 2);
+#endif // LUA_VERSION_NUM
+  next = luaL_optinteger (L, 3, 1);
+
+  luaL_argcheck (L, count > 0, 2, "expected at least one bank");
+  luaL_argcheck (L, next >= 1 && next <= count, 3, "bank index out of range");
+
+  for (i = 1; i <= count; i++)
+  {
+    lua_rawgeti (L, 2, i);
+    luaL_argcheck (L, luaL_testudata (L, -1, META), 2, "expected a list of banks");
+    lua_pop (L, 1);
+  }
+
+  streams = g_new (GOutputStream*, count);
+  fills = g_new0 (gsize, count);
+  buffer = g_malloc (CHUNK);
+  stage = g_malloc (count * STRIPE);
+
+  for (i = 0; i < count; i++)
+  {
+    lua_rawgeti (L, 2, i + 1);
+    streams [i] = ((SmipsBank*) lua_touserdata (L, -1))->stream;
+    lua_pop (L, 1);
+  }
+
+  _smips_block_reader_init (&reader, block);
+  i = (guint) (next - 1);
+
+  while (tmperr == NULL && (got = _smips_block_read (&reader, buffer, CHUNK)) > 0)
+  {
+    if (got % 4 != 0)
+    {
+      g_set_error_literal (&tmperr, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Unaligned write");
+      break;
+    }
+
+    for (at = 0; at < got && tmperr == NULL; at += 4)
+    {
+      memcpy (stage + i * STRIPE + fills [i], buffer + at, 4);
+
+      if ((fills [i] += 4) == STRIPE)
+        flushstripe (streams [i], stage + i * STRIPE, & fills [i], &tmperr);
+
+      i = (i + 1) % count;
+    }
+  }
+
+  for (j = 0; j < count && tmperr == NULL; j++)
+  {
+    if (fills [j] > 0)
+      flushstripe (streams [j], stage + j * STRIPE, & fills [j], &tmperr);
+  }
+
+  g_free (stage);
+  g_free (buffer);
+  g_free (fills);
+  g_free (streams);
+
+  if (G_UNLIKELY (tmperr != NULL))
+    _smips_log_gerror (L, 0, tmperr);
+return (lua_pushinteger (L, i + 1), 1);
+}
+
 G_MODULE_EXPORT
 int luaopen_banks (lua_State* L)
 {
-  lua_createtable (L, 0, 6);
+  lua_createtable (L, 0, 10);
   luaL_newmetatable (L, META);
 #if LUA_VERSION_NUM < 503
   lua_pushliteral (L, META);
@@ -194,6 +449,10 @@ int luaopen_banks (lua_State* L)
   lua_setfield (L, -2, "new");
   lua_pushcfunction (L, _close);
   lua_setfield (L, -2, "close");
+  lua_pushcfunction (L, _discard);
+  lua_setfield (L, -2, "discard");
+  lua_pushcfunction (L, symbols);
+  lua_setfield (L, -2, "symbols");
   lua_pushcfunction (L, zero);
   lua_setfield (L, -2, "zero");
   lua_pushcfunction (L, emit8);
@@ -202,5 +461,9 @@ int luaopen_banks (lua_State* L)
   lua_setfield (L, -2, "emit32");
   lua_pushcfunction (L, emits);
   lua_setfield (L, -2, "emits");
+  lua_pushcfunction (L, emitblock);
+  lua_setfield (L, -2, "emitblock");
+  lua_pushcfunction (L, stripe);
+  lua_setfield (L, -2, "stripe");
 return 1;
 }
@@ -0,0 +1,834 @@
+/* Copyright 2021-2025 MarcosHCK
+ * This file is part of SMIPS Assembler.
+ *
+ * SMIPS Assembler is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SMIPS Assembler is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with SMIPS Assembler. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <config.h>
+#include <blocks.h>
+#include <gmodule.h>
+#include <lua.h>
+#include <lauxlib.h>
+#include <luacmpt.h>
+
+typedef struct _LineState LineState;
+#define META "SmipsBlock"
+
+#if LUA_VERSION_NUM >= 502
+# define getuservalue(L,idx) lua_getuservalue ((L), (idx))
+# define setuservalue(L,idx) lua_setuservalue ((L), (idx))
+#else // LUA_VERSION_NUM < 502
+# define getuservalue(L,idx) lua_getfenv ((L), (idx))
+# define setuservalue(L,idx) lua_setfenv ((L), (idx))
+#endif // LUA_VERSION_NUM
+
+/*
+ * Entries are stored column-wise, one array per field. Columns
+ * are shared between kinds as follows:
+ *
+ * +-------+-------------+----------------+--------------+-------------+
+ * | Kind  | size        | word           | operand      | style       |
+ * +-------+-------------+----------------+--------------+-------------+
+ * | r,i,j | 4           | encoded inst   | constant     | fixup style |
+ * | data  | padded size | offset in pool | byte count   | -           |
+ * | zero  | size        | -              | -            | -           |
+ * | org   | gap size    | address        | -            | -           |
+ * | delay | size        | transform      | expression   | -           |
+ * +-------+-------------+----------------+--------------+-------------+
+ *
+ * Zero and org entries are gaps, never backed by actual bytes;
+ * an org gap is sized once its entry is placed
+ *
+ * Operands, transforms and sources are handles into an interned
+ * table of Lua values (strings, integer IDs for anonymous tags,
+ * or fixup programs read from objects) kept as the block's user
+ * value; handle 0 means none
+ *
+ * Source locations live apart in a line program: one row per
+ * annotated entry holding the entry index delta (its low bit
+ * flags a source change, followed by the new source handle)
+ * and the zigzag-encoded line delta, all as ULEB128 numbers.
+ * Decoder state is checkpointed every LINE_MARK rows
+ *
+ */
+
+#define LINE_MARK (64)
+
+struct _LineState
+{
+  guint offset;
+  guint index;
+  guint source;
+  guint line;
+};
+
+enum
+{
+  KIND_RINST,
+  KIND_IINST,
+  KIND_JINST,
+  KIND_DATA,
+  KIND_ZERO,
+  KIND_ORG,
+  KIND_DELAY,
+};
+
+struct _SmipsBlock
+{
+  GArray* kinds;
+  GArray* styles;
+  GArray* sizes;
+  GArray* offsets;
+  GArray* words;
+  GArray* operands;
+  GArray* seqs;
+  GByteArray* pool;
+  GByteArray* lineprog;
+  GArray* linemarks;
+  LineState linelast;
+  LineState linecursor;
+  guint linerows;
+  guint handles;
+};
+
+#define column(self,name,type,i) (g_array_index ((self)->name, type, (i)))
+
+static const gchar* kinds [] = { "r", "i", "j", "data", "zero", "org", "delay", NULL, };
+
+static SmipsBlock* checkblock (lua_State* L, int idx)
+{
+return luaL_checkudata (L, idx, META);
+}
+
+static guint checkentry (lua_State* L, SmipsBlock* self, int idx)
+{
+  const lua_Integer i = luaL_checkinteger (L, idx);
+  luaL_argcheck (L, i >= 1 && i <= self->kinds->len, idx, "entry index out of range");
+return (guint) (i - 1);
+}
+
+/*
+ * Handles
+ *
+ */
+
+static guint intern (lua_State* L, SmipsBlock* self, int ubidx, int idx)
+{
+  guint handle;
+
+  if (lua_isnoneornil (L, idx))
+    return 0;
+
+  idx = (idx < 0) ? lua_gettop (L) + idx + 1 : idx;
+  getuservalue (L, ubidx);
+  lua_rawgeti (L, -1, 2);
+  lua_pushvalue (L, idx);
+  lua_rawget (L, -2);
+
+  if (!lua_isnil (L, -1))
+    handle = (guint) lua_tointeger (L, -1);
+  else
+  {
+    handle = ++self->handles;
+    lua_pushvalue (L, idx);
+    lua_pushinteger (L, handle);
+    lua_rawset (L, -4);
+    lua_rawgeti (L, -3, 1);
+    lua_pushvalue (L, idx);
+    lua_rawseti (L, -2, handle);
+    lua_pop (L, 1);
+  }
+
+  lua_pop (L, 3);
+return handle;
+}
+
+static void pushhandle (lua_State* L, int ubidx, guint handle)
+{
+  if (handle == 0)
+    lua_pushnil (L);
+  else
+  {
+    getuservalue (L, ubidx);
+    lua_rawgeti (L, -1, 1);
+    lua_rawgeti (L, -1, handle);
+    lua_replace (L, -3);
+    lua_pop (L, 1);
+  }
+}
+
+/*
+ * Entries
+ *
+ */
+
+static guint append (SmipsBlock* self, int kind, guint size)
+{
+  const guint8 kind8 = (guint8) kind;
+  const guint zero = 0;
+
+  g_array_append_val (self->kinds, kind8);
+  g_array_append_val (self->styles, zero);
+  g_array_append_val (self->sizes, size);
+  g_array_append_val (self->offsets, zero);
+  g_array_append_val (self->words, zero);
+  g_array_append_val (self->operands, zero);
+  g_array_append_val (self->seqs, zero);
+return self->kinds->len - 1;
+}
+
+static void setdata (SmipsBlock* self, guint i, const gchar* data, gsize length)
+{
+  column (self, kinds, guint8, i) = KIND_DATA;
+  column (self, words, guint, i) = self->pool->len;
+  column (self, operands, guint, i) = (guint) length;
+  g_byte_array_append (self->pool, (const guint8*) data, length);
+}
+
+/*
+ * Line table
+ *
+ */
+
+static void putuleb (GByteArray* prog, guint value)
+{
+  guint8 byte;
+
+  do
+  {
+    byte = value & 0x7f;
+    value >>= 7;
+    byte |= (value > 0) ? 0x80 : 0;
+    g_byte_array_append (prog, &byte, 1);
+  }
+  while (value > 0);
+}
+
+static guint getuleb (const GByteArray* prog, guint* offset)
+{
+  guint value = 0, shift = 0;
+  guint8 byte;
+
+  do
+  {
+    byte = prog->data [(*offset)++];
+    value |= (guint) (byte & 0x7f) << shift;
+    shift += 7;
+  }
+  while ((byte & 0x80) != 0);
+return value;
+}
+
+static void addrow (SmipsBlock* self, guint index, guint source, guint line)
+{
+  LineState* last = & self->linelast;
+  const gint delta = (gint) line - (gint) last->line;
+  const gboolean fresh = source != last->source;
+
+  if (self->linerows++ % LINE_MARK == 0)
+  {
+    last->offset = self->lineprog->len;
+    g_array_append_val (self->linemarks, *last);
+  }
+
+  putuleb (self->lineprog, ((index - last->index) << 1) | fresh);
+  if (fresh)
+    putuleb (self->lineprog, source);
+  putuleb (self->lineprog, (guint) ((delta << 1) ^ (delta >> 31)));
+
+  last->index = index;
+  last->source = source;
+  last->line = line;
+}
+
+static void nextrow (const SmipsBlock* self, LineState* state)
+{
+  const guint head = getuleb (self->lineprog, &state->offset);
+  guint delta;
+
+  state->index += head >> 1;
+  if ((head & 1) != 0)
+    state->source = getuleb (self->lineprog, &state->offset);
+  delta = getuleb (self->lineprog, &state->offset);
+  state->line += (guint) ((delta >> 1) ^ -(delta & 1));
+}
+
+static gboolean locate (SmipsBlock* self, guint index, guint* source, guint* line)
+{
+  LineState state = self->linecursor;
+  LineState next;
+  gboolean found = FALSE;
+  guint lo, hi, mid;
+
+  if (index == 0 || self->linemarks->len == 0)
+    return FALSE;
+
+  /* sequential lookups resume where the last one stopped */
+  if (state.index >= index)
+  {
+    for (lo = 0, hi = self->linemarks->len; hi - lo > 1;)
+    {
+      mid = (lo + hi) / 2;
+
+      if (g_array_index (self->linemarks, LineState, mid).index < index)
+        lo = mid;
+      else
+        hi = mid;
+    }
+
+    state = g_array_index (self->linemarks, LineState, lo);
+  }
+
+  while (state.offset < self->lineprog->len)
+  {
+    next = state;
+    nextrow (self, &next);
+
+    if (next.index > index)
+      break;
+    else
+    {
+      state = next;
+
+      if (state.index == index)
+      {
+        *source = state.source;
+        *line = state.line;
+        found = TRUE;
+      }
+    }
+  }
+
+  self->linecursor = state;
+return found;
+}
+
+static int __gc (lua_State* L)
+{
+  SmipsBlock* self = checkblock (L, 1);
+  g_clear_pointer (&self->kinds, g_array_unref);
+  g_clear_pointer (&self->styles, g_array_unref);
+  g_clear_pointer (&self->sizes, g_array_unref);
+  g_clear_pointer (&self->offsets, g_array_unref);
+  g_clear_pointer (&self->words, g_array_unref);
+  g_clear_pointer (&self->operands, g_array_unref);
+  g_clear_pointer (&self->seqs, g_array_unref);
+  g_clear_pointer (&self->pool, g_byte_array_unref);
+  g_clear_pointer (&self->lineprog, g_byte_array_unref);
+  g_clear_pointer (&self->linemarks, g_array_unref);
+return 0;
+}
+
+static int _new (lua_State* L)
+{
+  const gsize sz = sizeof (SmipsBlock);
+  SmipsBlock* self = lua_newuserdata (L, sz);
+
+  memset (self, 0, sz);
+#if LUA_VERSION_NUM >= 502
+  luaL_setmetatable (L, META);
+#else // LUA_VERSION_NUM < 502
+  lua_getfield (L, LUA_REGISTRYINDEX, META);
+  lua_setmetatable (L, -2);
+#endif // LUA_VERSION_NUM
+
+  lua_createtable (L, 2, 0);
+  lua_newtable (L);
+  lua_rawseti (L, -2, 1);
+  lua_newtable (L);
+  lua_rawseti (L, -2, 2);
+  setuservalue (L, -2);
+
+  self->kinds = g_array_new (FALSE, FALSE, sizeof (guint8));
+  self->styles = g_array_new (FALSE, FALSE, sizeof (guint8));
+  self->sizes = g_array_new (FALSE, FALSE, sizeof (guint));
+  self->offsets = g_array_new (FALSE, FALSE, sizeof (guint));
+  self->words = g_array_new (FALSE, FALSE, sizeof (guint));
+  self->operands = g_array_new (FALSE, FALSE, sizeof (guint));
+  self->seqs = g_array_new (FALSE, FALSE, sizeof (guint));
+  self->pool = g_byte_array_new ();
+  self->lineprog = g_byte_array_new ();
+  self->linemarks = g_array_new (FALSE, FALSE, sizeof (LineState));
+
+  append (self, KIND_ZERO, 0);
+return 1;
+}
+
+static int length (lua_State* L)
+{
+  SmipsBlock* self = checkblock (L, 1);
+return (lua_pushinteger (L, self->kinds->len), 1);
+}
+
+static int inst (lua_State* L)
+{
+  SmipsBlock* self = checkblock (L, 1);
+  const int kind = luaL_checkoption (L, 2, NULL, kinds);
+  const guint word = (guint) luaL_checkinteger (L, 3);
+  const gchar* style = luaL_optstring (L, 5, "");
+  guint i;
+
+  luaL_argcheck (L, kind <= KIND_JINST, 2, "expected instruction type");
+  i = append (self, kind, 4);
+
+  column (self, words, guint, i) = word;
+  column (self, operands, guint, i) = intern (L, self, 1, 4);
+  column (self, styles, guint8, i) = (guint8) style [0];
+return (lua_pushinteger (L, i + 1), 1);
+}
+
+static int data (lua_State* L)
+{
+  size_t length;
+  SmipsBlock* self = checkblock (L, 1);
+  const gchar* value = luaL_checklstring (L, 2, &length);
+  const guint size = (guint) ((length + 3) & ~3);
+  guint i;
+
+  i = append (self, KIND_DATA, size);
+  setdata (self, i, value, length);
+return (lua_pushinteger (L, i + 1), 1);
+}
+
+static int zero (lua_State* L)
+{
+  SmipsBlock* self = checkblock (L, 1);
+  const lua_Integer size = luaL_checkinteger (L, 2);
+  guint i;
+
+  luaL_argcheck (L, size >= 0, 2, "expected a non-negative size");
+  i = append (self, KIND_ZERO, (guint) ((size + 3) & ~3));
+return (lua_pushinteger (L, i + 1), 1);
+}
+
+static int org (lua_State* L)
+{
+  SmipsBlock* self = checkblock (L, 1);
+  const lua_Integer address = luaL_checkinteger (L, 2);
+  guint i;
+
+  luaL_argcheck (L, address >= 0 && address % 4 == 0, 2, "expected a word aligned address");
+  i = append (self, KIND_ORG, 0);
+  column (self, words, guint, i) = (guint) address;
+return (lua_pushinteger (L, i + 1), 1);
+}
+
+static int delay (lua_State* L)
+{
+  SmipsBlock* self = checkblock (L, 1);
+  const lua_Integer size = luaL_checkinteger (L, 2);
+  guint i;
+
+  luaL_checkany (L, 3);
+  luaL_checkstring (L, 4);
+  i = append (self, KIND_DELAY, (guint) ((size + 3) & ~3));
+
+  column (self, operands, guint, i) = intern (L, self, 1, 3);
+  column (self, words, guint, i) = intern (L, self, 1, 4);
+return (lua_pushinteger (L, i + 1), 1);
+}
+
+static int annotate (lua_State* L)
+{
+  SmipsBlock* self = checkblock (L, 1);
+  const guint i = self->kinds->len - 1;
+
+  luaL_checkstring (L, 2);
+  addrow (self, i, intern (L, self, 1, 2), (guint) luaL_checkinteger (L, 3));
+return 0;
+}
+
+static int sequence (lua_State* L)
+{
+  SmipsBlock* self = checkblock (L, 1);
+  const guint i = self->kinds->len - 1;
+
+  column (self, seqs, guint, i) = (guint) luaL_checkinteger (L, 2);
+return 0;
+}
+
+static int get (lua_State* L)
+{
+  SmipsBlock* self = checkblock (L, 1);
+  const guint i = checkentry (L, self, 2);
+  const int kind = column (self, kinds, guint8, i);
+  const guint seq = column (self, seqs, guint, i);
+  const guint8 style = column (self, styles, guint8, i);
+
+  lua_pushstring (L, kinds [kind]);
+  lua_pushinteger (L, column (self, sizes, guint, i));
+
+  switch (kind)
+  {
+    case KIND_RINST:
+    case KIND_IINST:
+    case KIND_JINST:
+      pushhandle (L, 1, column (self, operands, guint, i));
+      if (style == 0)
+        lua_pushnil (L);
+      else
+        lua_pushlstring (L, (const gchar*) &style, 1);
+      break;
+    case KIND_DELAY:
+      pushhandle (L, 1, column (self, operands, guint, i));
+      pushhandle (L, 1, column (self, words, guint, i));
+      break;
+    case KIND_ORG:
+      lua_pushinteger (L, column (self, words, guint, i));
+      lua_pushnil (L);
+      break;
+    default:
+      lua_pushnil (L);
+      lua_pushnil (L);
+      break;
+  }
+
+  if (seq == 0)
+    lua_pushnil (L);
+  else
+    lua_pushinteger (L, seq);
+return 5;
+}
+
+static int where (lua_State* L)
+{
+  SmipsBlock* self = checkblock (L, 1);
+  const guint i = checkentry (L, self, 2);
+  guint source, line;
+
+  if (!locate (self, i, &source, &line))
+    return 0;
+
+  pushhandle (L, 1, source);
+  lua_pushinteger (L, line);
+return 2;
+}
+
+static int word (lua_State* L)
+{
+  SmipsBlock* self = checkblock (L, 1);
+  const guint i = checkentry (L, self, 2);
+
+  luaL_argcheck (L, column (self, kinds, guint8, i) <= KIND_JINST, 2, "not an instruction");
+return (lua_pushinteger (L, column (self, words, guint, i)), 1);
+}
+
+static int bytes (lua_State* L)
+{
+  SmipsBlock* self = checkblock (L, 1);
+  const guint i = checkentry (L, self, 2);
+  const guint size = column (self, sizes, guint, i);
+  const guint length = column (self, operands, guint, i);
+  const guint at = column (self, words, guint, i);
+  luaL_Buffer B;
+  guint j;
+
+  switch (column (self, kinds, guint8, i))
+  {
+    case KIND_DATA:
+      luaL_buffinit (L, &B);
+      luaL_addlstring (&B, (const gchar*) self->pool->data + at, length);
+      for (j = length; j < size; j++)
+        luaL_addchar (&B, '\0');
+      luaL_pushresult (&B);
+      break;
+    default:
+      luaL_argerror (L, 2, "not a data entry");
+      break;
+  }
+return 1;
+}
+
+static int place (lua_State* L)
+{
+  SmipsBlock* self = checkblock (L, 1);
+  const guint i = checkentry (L, self, 2);
+
+  column (self, offsets, guint, i) = (guint) luaL_checkinteger (L, 3);
+return 0;
+}
+
+static int resize (lua_State* L)
+{
+  SmipsBlock* self = checkblock (L, 1);
+  const guint i = checkentry (L, self, 2);
+  const lua_Integer size = luaL_checkinteger (L, 3);
+
+  luaL_argcheck (L, column (self, kinds, guint8, i) == KIND_ORG, 2, "not an org entry");
+  luaL_argcheck (L, size >= 0 && size % 4 == 0, 3, "expected a word aligned size");
+  column (self, sizes, guint, i) = (guint) size;
+return 0;
+}
+
+SmipsBlock* _smips_block_check (lua_State* L, int idx)
+{
+return checkblock (L, idx);
+}
+
+gboolean _smips_block_endof (const SmipsBlock* self, lua_Integer index, guint* value)
+{
+  if (index < 1 || index > self->kinds->len)
+    return FALSE;
+
+  *value = column (self, offsets, guint, index - 1)
+         + column (self, sizes, guint, index - 1);
+return TRUE;
+}
+
+static int endof (lua_State* L)
+{
+  SmipsBlock* self = checkblock (L, 1);
+  const guint i = checkentry (L, self, 2);
+  const guint offset = column (self, offsets, guint, i);
+  const guint size = column (self, sizes, guint, i);
+return (lua_pushinteger (L, offset + size), 1);
+}
+
+gboolean _smips_block_patch (SmipsBlock* self, lua_Integer index, guint constant)
+{
+  guint* word;
+
+  if (index < 1 || index > self->kinds->len)
+    return FALSE;
+
+  word = & column (self, words, guint, index - 1);
+
+  switch (column (self, kinds, guint8, index - 1))
+  {
+    case KIND_IINST:
+      *word = (*word & ~0xffff) | (constant & 0xffff);
+      return TRUE;
+    case KIND_JINST:
+      *word = (*word & ~0x3ffffff) | (constant & 0x3ffffff);
+      return TRUE;
+  }
+return FALSE;
+}
+
+void _smips_block_reader_init (SmipsBlockReader* reader, const SmipsBlock* block)
+{
+  reader->block = block;
+  reader->entry = 0;
+  reader->done = 0;
+}
+
+gsize _smips_block_read (SmipsBlockReader* reader, guint8* buffer, gsize size)
+{
+  const SmipsBlock* self = reader->block;
+  gsize wrote = 0;
+
+  while (wrote < size && reader->entry < self->kinds->len)
+  {
+    const guint i = reader->entry;
+    const guint length = column (self, sizes, guint, i);
+    const gsize chunk = MIN (size - wrote, length - reader->done);
+    guint8* out = buffer + wrote;
+
+    switch (column (self, kinds, guint8, i))
+    {
+      case KIND_RINST:
+      case KIND_IINST:
+      case KIND_JINST:
+        {
+          const guint32 word = GUINT32_TO_LE (column (self, words, guint, i));
+          memcpy (out, ((const guint8*) &word) + reader->done, chunk);
+        }
+        break;
+
+      case KIND_DATA:
+        {
+          const guint have = column (self, operands, guint, i);
+          const guint8* data = self->pool->data + column (self, words, guint, i);
+          const gsize copy = (reader->done >= have) ? 0 : MIN (chunk, have - reader->done);
+
+          memcpy (out, data + reader->done, copy);
+          memset (out + copy, 0, chunk - copy);
+        }
+        break;
+
+      default:
+        memset (out, 0, chunk);
+        break;
+    }
+
+    wrote += chunk;
+
+    if ((reader->done += chunk) == length)
+    {
+      reader->entry++;
+      reader->done = 0;
+    }
+  }
+return wrote;
+}
+
+static int patch (lua_State* L)
+{
+  SmipsBlock* self = checkblock (L, 1);
+  const guint i = checkentry (L, self, 2);
+  const guint constant = (guint) luaL_checkinteger (L, 3);
+
+  if (!_smips_block_patch (self, i + 1, constant))
+    luaL_argerror (L, 2, "instruction takes no constant");
+return 0;
+}
+
+static int fill (lua_State* L)
+{
+  size_t length;
+  SmipsBlock* self = checkblock (L, 1);
+  const guint i = checkentry (L, self, 2);
+  const gchar* value = luaL_checklstring (L, 3, &length);
+
+  luaL_argcheck (L, column (self, kinds, guint8, i) == KIND_DELAY, 2, "not a delayed entry");
+  luaL_argcheck (L, length <= column (self, sizes, guint, i), 3, "data does not fit entry");
+  setdata (self, i, value, length);
+return 0;
+}
+
+static int concat (lua_State* L)
+{
+  SmipsBlock* self = checkblock (L, 1);
+  SmipsBlock* other = checkblock (L, 2);
+  const lua_Integer anons = luaL_checkinteger (L, 3);
+  const lua_Integer seqs = luaL_checkinteger (L, 4);
+  const guint base = self->kinds->len - 1;
+  guint i, j, kind, handle, *slot;
+  LineState state = { 0, };
+  guint source = 0;
+
+  lua_settop (L, 2);
+
+  /* entry 0 is the empty head every block starts with */
+  for (i = 1; i < other->kinds->len; i++)
+  {
+    kind = column (other, kinds, guint8, i);
+    j = append (self, kind, column (other, sizes, guint, i));
+
+    column (self, styles, guint8, j) = column (other, styles, guint8, i);
+    column (self, words, guint, j) = column (other, words, guint, i);
+    column (self, operands, guint, j) = column (other, operands, guint, i);
+
+    if ((handle = column (other, seqs, guint, i)) > 0)
+      column (self, seqs, guint, j) = handle + (guint) seqs;
+
+    switch (kind)
+    {
+      case KIND_DATA:
+        column (self, words, guint, j) = self->pool->len;
+        g_byte_array_append (self->pool, other->pool->data + column (other, words, guint, i), column (other, operands, guint, i));
+        break;
+
+      case KIND_DELAY:
+        pushhandle (L, 2, column (other, words, guint, i));
+        column (self, words, guint, j) = intern (L, self, 1, -1);
+        lua_pop (L, 1);
+        G_GNUC_FALLTHROUGH;
+      case KIND_RINST:
+      case KIND_IINST:
+      case KIND_JINST:
+        slot = & column (self, operands, guint, j);
+
+        if (*slot > 0)
+        {
+          pushhandle (L, 2, *slot);
+
+          /* anonymous tag IDs are rebased */
+          if (lua_type (L, -1) == LUA_TNUMBER)
+          {
+            lua_pushinteger (L, lua_tointeger (L, -1) + anons);
+            lua_replace (L, -2);
+          }
+
+          *slot = intern (L, self, 1, -1);
+          lua_pop (L, 1);
+        }
+        break;
+    }
+  }
+
+  /* line rows are replayed, sources re-interned as they change */
+  for (handle = 0; state.offset < other->lineprog->len;)
+  {
+    nextrow (other, &state);
+
+    if (state.index == 0)
+      continue;
+    if (state.source != handle)
+    {
+      pushhandle (L, 2, (handle = state.source));
+      source = intern (L, self, 1, -1);
+      lua_pop (L, 1);
+    }
+
+    addrow (self, state.index + base, source, state.line);
+  }
+return 0;
+}
+
+G_MODULE_EXPORT
+int luaopen_blocks (lua_State* L)
+{
+  lua_createtable (L, 0, 19);
+  luaL_newmetatable (L, META);
+#if LUA_VERSION_NUM < 503
+  lua_pushliteral (L, META);
+  lua_setfield (L, -2, "__name");
+#endif // LUA_VERSION_NUM
+  lua_pushcfunction (L, __gc);
+  lua_setfield (L, -2, "__gc");
+  lua_pushvalue (L, -2);
+  lua_setfield (L, -2, "__index");
+  lua_pop (L, 1);
+
+  lua_pushcfunction (L, _new);
+  lua_setfield (L, -2, "new");
+  lua_pushcfunction (L, length);
+  lua_setfield (L, -2, "length");
+  lua_pushcfunction (L, inst);
+  lua_setfield (L, -2, "inst");
+  lua_pushcfunction (L, data);
+  lua_setfield (L, -2, "data");
+  lua_pushcfunction (L, zero);
+  lua_setfield (L, -2, "zero");
+  lua_pushcfunction (L, org);
+  lua_setfield (L, -2, "org");
+  lua_pushcfunction (L, delay);
+  lua_setfield (L, -2, "delay");
+  lua_pushcfunction (L, annotate);
+  lua_setfield (L, -2, "annotate");
+  lua_pushcfunction (L, sequence);
+  lua_setfield (L, -2, "sequence");
+  lua_pushcfunction (L, get);
+  lua_setfield (L, -2, "get");
+  lua_pushcfunction (L, where);
+  lua_setfield (L, -2, "where");
+  lua_pushcfunction (L, word);
+  lua_setfield (L, -2, "word");
+  lua_pushcfunction (L, bytes);
+  lua_setfield (L, -2, "bytes");
+  lua_pushcfunction (L, place);
+  lua_setfield (L, -2, "place");
+  lua_pushcfunction (L, resize);
+  lua_setfield (L, -2, "resize");
+  lua_pushcfunction (L, endof);
+  lua_setfield (L, -2, "endof");
+  lua_pushcfunction (L, patch);
+  lua_setfield (L, -2, "patch");
+  lua_pushcfunction (L, fill);
+  lua_setfield (L, -2, "fill");
+  lua_pushcfunction (L, concat);
+  lua_setfield (L, -2, "concat");
+return 1;
+}
@@ -0,0 +1,56 @@
+/* Copyright 2021-2025 MarcosHCK
+ * This file is part of SMIPS Assembler.
+ *
+ * SMIPS Assembler is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SMIPS Assembler is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with SMIPS Assembler. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef __SMIPS_BLOCKS__
+#define __SMIPS_BLOCKS__ 1
+#include <glib.h>
+#include <lua.h>
+#include <lauxlib.h>
+#include <luacmpt.h>
+
+typedef struct _SmipsBlock SmipsBlock;
+typedef struct _SmipsBlockReader SmipsBlockReader;
+
+#if __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+/*
+ * Reads the image of a placed block as it should be
+ * written out, instructions little-endian and gaps as
+ * zeroes, picking up where the previous read stopped
+ *
+ */
+
+struct _SmipsBlockReader
+{
+  const SmipsBlock* block;
+  guint entry;
+  guint done;
+};
+
+G_GNUC_INTERNAL SmipsBlock* _smips_block_check (lua_State* L, int idx);
+G_GNUC_INTERNAL gboolean _smips_block_endof (const SmipsBlock* block, lua_Integer index, guint* value);
+G_GNUC_INTERNAL gboolean _smips_block_patch (SmipsBlock* block, lua_Integer index, guint constant);
+G_GNUC_INTERNAL void _smips_block_reader_init (SmipsBlockReader* reader, const SmipsBlock* block);
+G_GNUC_INTERNAL gsize _smips_block_read (SmipsBlockReader* reader, guint8* buffer, gsize size);
+
+#if __cplusplus
+}
+#endif // __cplusplus
+
+#endif // __SMIPS_BLOCKS__
@@ -0,0 +1,116 @@
+/* Copyright 2021-2025 MarcosHCK
+ * This file is part of SMIPS Assembler.
+ *
+ * SMIPS Assembler is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SMIPS Assembler is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with SMIPS Assembler. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <config.h>
+#include <gmodule.h>
+#include <lua.h>
+#include <lauxlib.h>
+#include <luacmpt.h>
+#include <log.h>
+
+#define _g_free0(var) ((var == NULL) ? NULL : (var = (g_free (var), NULL)))
+
+/*
+ * Bump whenever the layout of dumped units changes
+ *
+ */
+#define CACHE_FORMAT "5"
+
+static int key (lua_State* L)
+{
+  const gchar* path = luaL_checkstring (L, 1);
+  const gchar* version = PACKAGE_STRING "+" CACHE_FORMAT;
+  GMappedFile* mapped = NULL;
+  GChecksum* checksum = NULL;
+  GError* tmperr = NULL;
+
+  if ((mapped = g_mapped_file_new (path, FALSE, &tmperr)) == NULL)
+    _smips_log_gerror (L, 1, tmperr);
+
+  checksum = g_checksum_new (G_CHECKSUM_SHA256);
+  g_checksum_update (checksum, (const guchar*) version, strlen (version) + 1);
+  g_checksum_update (checksum, (const guchar*) path, strlen (path) + 1);
+  g_checksum_update (checksum, (const guchar*) g_mapped_file_get_contents (mapped), g_mapped_file_get_length (mapped));
+  g_mapped_file_unref (mapped);
+
+  lua_pushstring (L, g_checksum_get_string (checksum));
+  g_checksum_free (checksum);
+return 1;
+}
+
+static int load (lua_State* L)
+{
+  const gchar* dir = luaL_checkstring (L, 1);
+  const gchar* name = luaL_checkstring (L, 2);
+  gchar* path = g_build_filename (dir, name, NULL);
+  gchar* contents = NULL;
+  gsize length = 0;
+
+  if (!g_file_get_contents (path, &contents, &length, NULL))
+    lua_pushnil (L);
+  else
+  {
+    lua_pushlstring (L, contents, length);
+    _g_free0 (contents);
+  }
+
+  _g_free0 (path);
+return 1;
+}
+
+static int store (lua_State* L)
+{
+  size_t length;
+  const gchar* dir = luaL_checkstring (L, 1);
+  const gchar* name = luaL_checkstring (L, 2);
+  const gchar* contents = luaL_checklstring (L, 3, &length);
+  gchar* path = NULL;
+  GError* tmperr = NULL;
+
+  if (g_mkdir_with_parents (dir, 0755) < 0)
+  {
+    lua_pushnil (L);
+    lua_pushfstring (L, "Can not create cache directory '%s'", dir);
+    return 2;
+  }
+
+  path = g_build_filename (dir, name, NULL);
+  g_file_set_contents (path, contents, length, &tmperr);
+  _g_free0 (path);
+
+  if (G_UNLIKELY (tmperr != NULL))
+  {
+    lua_pushnil (L);
+    lua_pushstring (L, tmperr->message);
+    g_error_free (tmperr);
+    return 2;
+  }
+return (lua_pushboolean (L, TRUE), 1);
+}
+
+G_MODULE_EXPORT
+int luaopen_caches (lua_State* L)
+{
+  lua_createtable (L, 0, 3);
+  lua_pushcfunction (L, key);
+  lua_setfield (L, -2, "key");
+  lua_pushcfunction (L, load);
+  lua_setfield (L, -2, "load");
+  lua_pushcfunction (L, store);
+  lua_setfield (L, -2, "store");
+return 1;
+}
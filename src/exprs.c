@@ -0,0 +1,567 @@
+/* Copyright 2021-2025 MarcosHCK
+ * This file is part of SMIPS Assembler.
+ *
+ * SMIPS Assembler is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SMIPS Assembler is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with SMIPS Assembler. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <config.h>
+#include <gmodule.h>
+#include <lua.h>
+#include <lauxlib.h>
+#include <luacmpt.h>
+
+typedef struct _Parser Parser;
+typedef struct _Operator Operator;
+
+#define isblank_(c) ((c) == ' ' || (c) == '\t' || (c) == '\r' || (c) == '\v' || (c) == '\f')
+#define isident(c) (g_ascii_isalnum ((c)) || (c) == '_')
+
+struct _Parser
+{
+  const gchar* p;
+  const gchar* end;
+  const gchar* error;
+  const gchar* near;
+};
+
+struct _Operator
+{
+  const gchar* name;
+  int length;
+  int priority;
+};
+
+enum
+{
+  OP_OR,
+  OP_XOR,
+  OP_AND,
+  OP_SHL,
+  OP_SHR,
+  OP_ADD,
+  OP_SUB,
+  OP_MUL,
+  OP_IDIV,
+  OP_DIV,
+  OP_MOD,
+};
+
+static const Operator operators [] =
+{
+  [OP_OR] = { "|", 1, 1, },
+  [OP_XOR] = { "~", 1, 2, },
+  [OP_AND] = { "&", 1, 3, },
+  [OP_SHL] = { "<<", 2, 4, },
+  [OP_SHR] = { ">>", 2, 4, },
+  [OP_ADD] = { "+", 1, 5, },
+  [OP_SUB] = { "-", 1, 5, },
+  [OP_MUL] = { "*", 1, 6, },
+  [OP_IDIV] = { "//", 2, 6, },
+  [OP_DIV] = { "/", 1, 6, },
+  [OP_MOD] = { "%", 1, 6, },
+};
+
+static gboolean binary (Parser* self, int limit, gint64* value);
+static gboolean unary (Parser* self, gint64* value);
+
+static gboolean fail (Parser* self, const gchar* error)
+{
+  self->error = error;
+  self->near = self->p;
+return FALSE;
+}
+
+static void skipblanks (Parser* self)
+{
+  while (self->p < self->end && isblank_ (*self->p))
+    self->p++;
+}
+
+/*
+ * Literals
+ *
+ */
+
+static gboolean escape (Parser* self, guint8* value)
+{
+  const gchar* p = self->p;
+  const gchar* end = self->end;
+  guint i, code = 0;
+
+  if (p >= end)
+    return fail (self, "unfinished string");
+
+  switch (*p)
+  {
+    case 'a': *value = '\a'; break;
+    case 'b': *value = '\b'; break;
+    case 'f': *value = '\f'; break;
+    case 'n': *value = '\n'; break;
+    case 'r': *value = '\r'; break;
+    case 't': *value = '\t'; break;
+    case 'v': *value = '\v'; break;
+    case '\\': *value = '\\'; break;
+    case '\"': *value = '\"'; break;
+    case '\'': *value = '\''; break;
+
+    case 'x':
+      for (i = 0, ++p; i < 2; i++, p++)
+      {
+        if (p >= end || !g_ascii_isxdigit (*p))
+          return fail (self, "hexadecimal digit expected");
+        code = (code << 4) | g_ascii_xdigit_value (*p);
+      }
+
+      *value = (guint8) code;
+      self->p = p;
+      return TRUE;
+
+    default:
+      if (!g_ascii_isdigit (*p))
+        return fail (self, "invalid escape sequence");
+
+      for (i = 0; i < 3 && p < end && g_ascii_isdigit (*p); i++, p++)
+        code = code * 10 + g_ascii_digit_value (*p);
+      if (code > 255)
+        return fail (self, "decimal escape too large");
+
+      *value = (guint8) code;
+      self->p = p;
+      return TRUE;
+  }
+
+  self->p = p + 1;
+return TRUE;
+}
+
+static gboolean string (Parser* self, luaL_Buffer* B, gsize* length)
+{
+  const gchar quote = *self->p++;
+  guint8 value;
+
+  *length = 0;
+
+  while (TRUE)
+  {
+    if (self->p >= self->end || *self->p == '\n')
+      return fail (self, "unfinished string");
+    else if (*self->p == quote)
+      break;
+    else if (*self->p != '\\')
+      value = (guint8) *self->p++;
+    else
+    {
+      self->p++;
+
+      if (!escape (self, &value))
+        return FALSE;
+    }
+
+    if (B != NULL)
+      luaL_addchar (B, (gchar) value);
+    ++(*length);
+  }
+
+  self->p++;
+return TRUE;
+}
+
+static gboolean character (Parser* self, gint64* value)
+{
+  const gchar* start = self->p;
+  gsize length;
+  guint8 byte;
+
+  if (!string (self, NULL, &length))
+    return FALSE;
+  if (length != 1)
+  {
+    self->p = start;
+    return fail (self, "attempt to perform arithmetic on a string value");
+  }
+
+  self->p = start + 1;
+
+  if (*self->p != '\\')
+    byte = (guint8) *self->p++;
+  else
+  {
+    self->p++;
+    escape (self, &byte);
+  }
+
+  self->p++;
+  *value = byte;
+return TRUE;
+}
+
+static gboolean number (Parser* self, gint64* value)
+{
+  const gchar* p = self->p;
+  const gchar* end = self->end;
+  guint64 accum = 0;
+  guint base = 10;
+  guint digit;
+
+  if (p + 1 < end && p [0] == '0' && (p [1] == 'x' || p [1] == 'X'))
+  {
+    base = 16;
+    p += 2;
+  }
+  else if (p + 1 < end && p [0] == '0' && (p [1] == 'b' || p [1] == 'B'))
+  {
+    base = 2;
+    p += 2;
+  }
+
+  if (p >= end || !g_ascii_isxdigit (*p))
+    return fail (self, "malformed number");
+
+  for (; p < end && isident (*p); p++)
+  {
+    if (!g_ascii_isxdigit (*p) || (digit = g_ascii_xdigit_value (*p)) >= base)
+      return fail (self, "malformed number");
+    accum = accum * base + digit;
+  }
+
+  self->p = p;
+  *value = (gint64) accum;
+return TRUE;
+}
+
+/*
+ * Expressions
+ *
+ */
+
+static gboolean apply (Parser* self, int op, gint64* value, gint64 right)
+{
+  const gint64 left = *value;
+
+  switch (op)
+  {
+    case OP_OR: *value = left | right; break;
+    case OP_XOR: *value = left ^ right; break;
+    case OP_AND: *value = left & right; break;
+    case OP_ADD: *value = (gint64) ((guint64) left + (guint64) right); break;
+    case OP_SUB: *value = (gint64) ((guint64) left - (guint64) right); break;
+    case OP_MUL: *value = (gint64) ((guint64) left * (guint64) right); break;
+
+    case OP_SHL:
+    case OP_SHR:
+      if (right <= -64 || right >= 64)
+        *value = 0;
+      else if ((right >= 0) == (op == OP_SHL))
+        *value = (gint64) ((guint64) left << (right >= 0 ? right : -right));
+      else
+        *value = (gint64) ((guint64) left >> (right >= 0 ? right : -right));
+      break;
+
+    case OP_DIV:
+    case OP_IDIV:
+    case OP_MOD:
+      if (right == 0)
+        return fail (self, "attempt to perform 'n//0'");
+      /* '/' yields a float in Lua, only exact quotients are taken */
+      else if (op == OP_DIV && right != -1 && left % right != 0)
+        return fail (self, "number has no integer representation");
+      else if (right == -1)
+        *value = (op == OP_MOD) ? 0 : (gint64) (- (guint64) left);
+      else
+      {
+        gint64 quot = left / right;
+        gint64 rem = left % right;
+
+        if (rem != 0 && (rem ^ right) < 0)
+        {
+          quot -= 1;
+          rem += right;
+        }
+
+        *value = (op == OP_MOD) ? rem : quot;
+      }
+      break;
+  }
+return TRUE;
+}
+
+static gboolean primary (Parser* self, gint64* value)
+{
+  skipblanks (self);
+
+  if (self->p >= self->end)
+    return fail (self, "unexpected end of expression");
+
+  switch (*self->p)
+  {
+    case '(':
+      ++self->p;
+      if (!binary (self, 0, value))
+        return FALSE;
+
+      skipblanks (self);
+
+      if (self->p >= self->end || *self->p != ')')
+        return fail (self, "')' expected");
+      ++self->p;
+      return TRUE;
+
+    case '\'':
+      return character (self, value);
+    case '\"':
+      return fail (self, "attempt to perform arithmetic on a string value");
+
+    default:
+      if (g_ascii_isdigit (*self->p))
+        return number (self, value);
+      break;
+  }
+return fail (self, "unexpected symbol");
+}
+
+/*
+ * As in Lua, '^' is exponentiation: it binds tighter than
+ * unary operators and groups to the right. Only results a
+ * double holds exactly are taken, anything else is left to
+ * Lua itself
+ *
+ */
+
+#define EXACT (G_GINT64_CONSTANT (1) << 53)
+
+static gboolean power (Parser* self, gint64 base, gint64 exponent, gint64* value)
+{
+  gint64 result = 1;
+
+  if (exponent < 0 || (exponent > 1 && (base > EXACT || base < -EXACT)))
+    return fail (self, "number has no integer representation");
+
+  /* by squaring; once |base| > 1 the loop ends within 53 rounds */
+  while (exponent > 0)
+  {
+    if ((exponent & 1) != 0)
+    {
+      if (result != 0 && (base > EXACT / ABS (result) || base < -EXACT / ABS (result)))
+        return fail (self, "number has no integer representation");
+      result *= base;
+    }
+
+    if ((exponent >>= 1) > 0)
+    {
+      if (ABS (base) > 1 && ABS (base) > EXACT / ABS (base))
+        return fail (self, "number has no integer representation");
+      base *= base;
+    }
+  }
+
+  *value = result;
+return TRUE;
+}
+
+static gboolean unary (Parser* self, gint64* value)
+{
+  gint64 exponent;
+
+  skipblanks (self);
+
+  if (self->p >= self->end)
+    return fail (self, "unexpected end of expression");
+
+  switch (*self->p)
+  {
+    case '-':
+      ++self->p;
+      if (!unary (self, value))
+        return FALSE;
+      *value = (gint64) (- (guint64) *value);
+      return TRUE;
+    case '+':
+      ++self->p;
+      return unary (self, value);
+    case '~':
+      ++self->p;
+      if (!unary (self, value))
+        return FALSE;
+      *value = ~*value;
+      return TRUE;
+  }
+
+  if (!primary (self, value))
+    return FALSE;
+
+  skipblanks (self);
+
+  if (self->p >= self->end || *self->p != '^')
+    return TRUE;
+
+  ++self->p;
+
+  if (!unary (self, &exponent))
+    return FALSE;
+return power (self, *value, exponent, value);
+}
+
+static int peekop (Parser* self)
+{
+  int i;
+  skipblanks (self);
+
+  for (i = 0; i < G_N_ELEMENTS (operators); i++)
+  {
+    const Operator* op = & operators [i];
+    if (self->end - self->p >= op->length && strncmp (self->p, op->name, op->length) == 0)
+      return i;
+  }
+return -1;
+}
+
+static gboolean binary (Parser* self, int limit, gint64* value)
+{
+  gint64 right;
+  int op;
+
+  if (!unary (self, value))
+    return FALSE;
+
+  while ((op = peekop (self)) >= 0 && operators [op].priority > limit)
+  {
+    self->p += operators [op].length;
+
+    if (!binary (self, operators [op].priority, &right))
+      return FALSE;
+    if (!apply (self, op, value, right))
+      return FALSE;
+  }
+return TRUE;
+}
+
+/*
+ * Lua API
+ *
+ */
+
+static int failed (lua_State* L, Parser* parser)
+{
+  lua_pushnil (L);
+
+  if (parser->near >= parser->end)
+    lua_pushfstring (L, "%s near <eof>", parser->error);
+  else
+  {
+    const gchar* near = parser->near;
+    const gchar* stop = near;
+
+    while (stop < parser->end && !isblank_ (*stop))
+      ++stop;
+
+    lua_pushlstring (L, near, stop - near);
+    lua_pushfstring (L, "%s near '%s'", parser->error, lua_tostring (L, -1));
+    lua_remove (L, -2);
+  }
+return 2;
+}
+
+static int escaped (lua_State* L, const gchar* expr, gsize length)
+{
+  const gchar* code = NULL;
+  size_t size;
+  luaL_Buffer B;
+
+  luaL_buffinit (L, &B);
+  luaL_addstring (&B, "do return ");
+  luaL_addlstring (&B, expr, length);
+  luaL_addstring (&B, "; end");
+  luaL_pushresult (&B);
+  code = lua_tolstring (L, -1, &size);
+
+  if (luaL_loadbuffer (L, code, size, "=expression") != LUA_OK)
+  {
+    lua_pushnil (L);
+    lua_insert (L, -2);
+    return 2;
+  }
+
+  lua_newtable (L);
+#if LUA_VERSION_NUM >= 502
+  lua_setupvalue (L, -2, 1);
+#else // LUA_VERSION_NUM < 502
+  lua_setfenv (L, -2);
+#endif // LUA_VERSION_NUM
+
+  if (lua_pcall (L, 0, 1, 0) != LUA_OK)
+  {
+    lua_pushnil (L);
+    lua_insert (L, -2);
+    return 2;
+  }
+return 1;
+}
+
+static int eval (lua_State* L)
+{
+  size_t length;
+  const gchar* expr = luaL_checklstring (L, 1, &length);
+  Parser parser = { expr, expr + length, NULL, NULL, };
+  gint64 value;
+  gsize size;
+
+  skipblanks (&parser);
+
+  if (parser.p < parser.end && *parser.p == '=')
+    return escaped (L, parser.p + 1, parser.end - parser.p - 1);
+
+  if (parser.p < parser.end && (*parser.p == '\"' || *parser.p == '\''))
+  {
+    const gchar* start = parser.p;
+    luaL_Buffer B;
+
+    luaL_buffinit (L, &B);
+
+    if (!string (&parser, &B, &size))
+      return failed (L, &parser);
+
+    skipblanks (&parser);
+
+    if (parser.p >= parser.end && (*start == '\"' || size != 1))
+    {
+      luaL_pushresult (&B);
+      return 1;
+    }
+
+    parser.p = start;
+  }
+
+  if (!binary (&parser, 0, &value))
+    return failed (L, &parser);
+  else
+  {
+    skipblanks (&parser);
+
+    if (parser.p < parser.end)
+    {
+      fail (&parser, "unexpected symbol");
+      return failed (L, &parser);
+    }
+  }
+return (lua_pushinteger (L, value), 1);
+}
+
+G_MODULE_EXPORT
+int luaopen_exprs (lua_State* L)
+{
+  lua_createtable (L, 0, 1);
+  lua_pushcfunction (L, eval);
+  lua_setfield (L, -2, "eval");
+return 1;
+}
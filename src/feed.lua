@@ -15,23 +15,13 @@
 --  You should have received a copy of the GNU General Public License
 --  along with SMIPS Assembler.  If not, see <http://www.gnu.org/licenses/>.
 ]]
+local exprs = require ('exprs')
 local insts = require ('insts')
+local isas = require ('isas')
+local lexers = require ('lexers')
 local log = require ('log')
 
-local anontag
 do
-  local anons = 0
-  function anontag ()
-    anons = anons + 1
-    return ('__anon%i__'):format (anons)
-  end
-end
-
-do
-  local regs = require ('isa').regs
-  local r_insts = require ('isa').r_insts
-  local i_insts = require ('isa').i_insts
-  local j_insts = require ('isa').j_insts
   local defaults = require ('isa').defaults
   local i_directives = require ('isa').i_directives
   local a_directives = require ('isa').a_directives
@@ -41,20 +31,7 @@ do
     local nexti = 0
     return function (...)
       nexti = nexti + 1
-      local arg = select (nexti, ...)
-      if (arg) then
-        arg = arg:gsub ('^%s*', '')
-        arg = arg:gsub ('%s*$', '')
-        return arg
-      end
-    end
-  end
-
-  local function breakargs (args)
-    local arg, left = args:match ('^([^,]+)(.*)$')
-    if (arg) then
-      left = left:gsub ('^,', '')
-      return arg, breakargs (left)
+      return (select (nexti, ...))
     end
   end
 
@@ -64,14 +41,15 @@ do
     if (not reg) then
       return nil
     else
-      return regs [reg]
+      return isas.register (reg)
     end
   end
 
-  local function feed (unit, source)
+  local function feed (unit, file, lexer)
+    local source = (file == '-') and '(stdin)' or file
+    local lexer = lexer or lexers.open (file, source)
     local linen = 0
-    local seq = 0
-    local line
+    local seq = unit.seqs
 
     local function compe (...)
 
@@ -91,69 +69,50 @@ do
     local function assertreg (value)
       if (value == nil) then
         compe ('Expected register name')
-      end
-
-      local reg = getreg (value)
-
-      if (not reg) then
+      elseif (type (value) ~= 'number') then
         compe ('Unknown register \'%s\'', value)
       end
-    return reg
+    return value
     end
 
     local function assertcs (value)
       if (value == nil) then
         compe ('Expected expression')
+      elseif (type (value) ~= 'string') then
+        compe ('Expected expression, got register')
       end
     return value
     end
 
     local function put_rinst (desc, rt, rs, rd, shamt)
-      local inst, loc
-      inst = insts.new (desc.opcode)
-      inst = inst:typer ()
+      local word
 
       if (not shamt) then
         shamt = 0
       else
-        local env = {}
-        local expr = ('do return %s; end'):format (shamt)
-        local chunk, reason, result
+        local value, reason = exprs.eval (shamt)
 
-        chunk, reason = load (expr, '=shamt', 't', env)
-        if (not chunk) then
+        if (value == nil) then
           compe (reason)
+        elseif (type (value) ~= 'number') then
+          compe ('Shift amount shold be a constant number')
         else
-          result, reason = pcall (chunk)
-          if (not result) then
-            compe (reason)
-          else
-            if (type (reason) ~= 'number') then
-              compe ('Shift amount shold be a constant number')
-            else
-              shamt = reason
-            end
-          end
+          shamt = value
         end
       end
 
-      inst.rt = rt
-      inst.rs = rs
-      inst.rd = rd
-      inst.shamt = shamt
-      inst.func = desc.func
-      unit:add_inst (inst)
+      word = insts.packr (desc.opcode, rs, rt, rd, shamt, desc.func)
+      unit:add_inst ('r', word)
       unit:annotate (source, linen)
     end
 
     local function put_iinst (desc, rt, rs, cs)
-      local inst, loc, addr
-      inst = insts.new (desc.opcode)
-      inst = inst:typei ()
-      inst.rt = desc.takes.rs_first and rs or rt
-      inst.rs = desc.takes.rs_first and rt or rs
+      local word, constant
+      local rt_ = desc.takes.rs_first and rs or rt
+      local rs_ = desc.takes.rs_first and rt or rs
 
-      if (desc.address) then
+      -- 'cs' is an anonymous tag ID for macro return points
+      if (desc.address and type (cs) == 'string') then
         local offset, left = cs:match ('^(%-?[0-9]+)%(([^%)]+)%)$')
         if (not offset) then
           if (desc.address == 'e') then
@@ -166,23 +125,22 @@ do
           if (not reg) then
             compe ('Invalid register \'%s\'', left)
           else
-            inst.rs = reg
-            inst.constant = offset
+            rs_ = reg
+            constant = tonumber (offset)
             cs = nil
           end
         end
       end
 
-      unit:add_inst (inst, cs, desc.tagable)
+      word = insts.packi (desc.opcode, rs_, rt_, constant)
+      unit:add_inst ('i', word, cs, desc.tagable)
       unit:annotate (source, linen)
       unit:sequence (seq)
     end
 
     local function put_jinst (desc, cs)
-      local inst, loc
-      inst = insts.new (desc.opcode)
-      inst = inst:typej ()
-      unit:add_inst (inst, cs, desc.tagable)
+      local word = insts.packj (desc.opcode)
+      unit:add_inst ('j', word, cs, desc.tagable)
       unit:annotate (source, linen)
       unit:sequence (seq)
     end
@@ -190,33 +148,35 @@ do
     local macros =
     {
       jal = function (getnext, ...)
-        local return_ = anontag ()
+        local return_ = unit:new_anon ()
         local target_ = assertcs (getnext (...))
 
-        put_iinst (i_insts.la, regs ['ra'], 0, return_)
-        put_jinst (j_insts.j, target_)
-        unit:add_tag (return_)
+        put_iinst (isas.lookup ('la'), isas.register ('ra'), 0, return_)
+        put_jinst (isas.lookup ('j'), target_)
+        unit:add_anon (return_)
       end,
     }
 
     local function feed_tag (tagname, islocal)
       if (islocal) then
-        local anon = anontag ()
         local alias = tonumber (tagname)
-        unit:add_local (alias, seq, anon)
+        unit:add_local (alias, seq)
       else
-        if (tagname:match ('__anon([0-9]+)__')) then
-          compe ('Tag name \'%s\' is reserved')
+        if (unit.symbols:lookup (tagname) ~= nil) then
+          compe ('Redefined tag \'%s\'', tagname)
         else
-          if (unit.tags [tagname] ~= nil) then
-            compe ('Redefined tag \'%s\'', tagname)
-          else
-            unit:add_tag (tagname)
-          end
+          unit:add_tag (tagname, source, linen)
         end
       end
     end
 
+    -- Entries added by directives get located too, so delayed
+    -- data can be diagnosed and resolve local tags
+    local function locate ()
+      unit:annotate (source, linen)
+      unit:sequence (seq)
+    end
+
     local function feed_directive (name, ...)
       if (i_directives [name] ~= nil) then
         local directive = i_directives [name]
@@ -224,6 +184,7 @@ do
           compe ('Directive \'%s\' takes no arguments', name)
         else
           directive (unit, compe)
+          locate ()
         end
       elseif (a_directives [name] ~= nil) then
         local directive = a_directives [name]
@@ -233,6 +194,7 @@ do
           compe ('Directive takes only one argument')
         else
           directive (arg, unit, compe)
+          locate ()
         end
       elseif (l_directives [name] ~= nil) then
         local directive = l_directives [name]
@@ -245,6 +207,7 @@ do
             compe ('Directive takes at least an argument')
           elseif (arg) then
             directive (arg, unit, compe)
+            locate ()
             first = false
           else
             break
@@ -255,36 +218,30 @@ do
       end
     end
 
-    local function feed_inst (inst, ...)
+    local function feed_inst (desc, ...)
       local getnext = argiter ()
 
-      if (macros [inst] ~= nil) then
-        macros [inst] (getnext, ...)
-      elseif (r_insts [inst] ~= nil) then
-        local desc = r_insts [inst]
-        local takes = desc.takes or {}
-        local _defaults = desc.defaults or defaults
-        local rd = takes.rd and assertreg (getnext (...)) or _defaults.rd
-        local rs = takes.rs and assertreg (getnext (...)) or _defaults.rs
-        local rt = takes.rt and assertreg (getnext (...)) or _defaults.rt
-        local shamt = takes.shamt and assertcs (getnext (...)) or _defaults.shamt
+      if (type (desc) ~= 'table') then
+        compe ('Unknown instruction \'%s\'', desc)
+      elseif (desc.type == 'macro') then
+        macros [desc.name] (getnext, ...)
+      elseif (desc.type == 'r') then
+        local takes = desc.takes
+        local rd = takes.rd and assertreg (getnext (...)) or defaults.rd
+        local rs = takes.rs and assertreg (getnext (...)) or defaults.rs
+        local rt = takes.rt and assertreg (getnext (...)) or defaults.rt
+        local shamt = takes.shamt and assertcs (getnext (...)) or defaults.shamt
         put_rinst (desc, rt, rs, rd, shamt)
-      elseif (i_insts [inst] ~= nil) then
-        local desc = i_insts [inst]
-        local takes = desc.takes or {}
-        local _defaults = desc.defaults or defaults
-        local rt = takes.rt and assertreg (getnext (...)) or _defaults.rt
-        local rs = takes.rs and assertreg (getnext (...)) or _defaults.rs
-        local cs = takes.cs and assertcs (getnext (...)) or _defaults.cs
+      elseif (desc.type == 'i') then
+        local takes = desc.takes
+        local rt = takes.rt and assertreg (getnext (...)) or defaults.rt
+        local rs = takes.rs and assertreg (getnext (...)) or defaults.rs
+        local cs = takes.cs and assertcs (getnext (...)) or defaults.cs
         put_iinst (desc, rt, rs, cs)
-      elseif (j_insts [inst] ~= nil) then
-        local desc = j_insts [inst]
-        local takes = desc.takes or {}
-        local _defaults = desc.defaults or defaults
-        local cs = takes.cs and assertcs (getnext (...)) or _defaults.cs
-        put_jinst (desc, cs)
       else
-        compe ('Unknown instruction \'%s\'', inst)
+        local takes = desc.takes
+        local cs = takes.cs and assertcs (getnext (...)) or defaults.cs
+        put_jinst (desc, cs)
       end
 
       if (getnext (...) ~= nil) then
@@ -292,75 +249,30 @@ do
       end
     end
 
-    local function feed_stat (stat)
-      local tag = stat:match ('^([0-9]+):$')
-              or stat:match ('^([a-zA-Z_][a-zA-Z_0-9]*):$')
-      if (tag ~= nil) then
-        return feed_tag (tag, not not tag:find ('^[0-9]'))
-      end
-
-      local name, left = stat:match ('^%.([a-z]+)(.*)$')
-      if (name ~= nil) then
-        if (#left == 0) then
-          return feed_directive (name)
-        else
-          local args = left:match ('^%s+(.*)$')
-          if (not args) then
-            compe ('Malformed line \'%s\'', line)
-          else
-            return feed_directive (name, breakargs (args))
-          end
-        end
-      end
-
-      local inst, left = stat:match ('^([a-z]+)(.*)$')
-      if (inst ~= nil) then
-        if (#left == 0) then
-          return feed_inst (inst)
-        else
-          local args = left:match ('^%s+(.*)$')
-          if (not args) then
-            compe ('Malformed line \'%s\'', line)
-          else
-            return feed_inst (inst, breakargs (args))
-          end
-        end
+    local function feed_stat (kind, name, ...)
+      if (kind == 'tag') then
+        return feed_tag (name, false)
+      elseif (kind == 'local') then
+        return feed_tag (name, true)
+      elseif (kind == 'directive') then
+        return feed_directive (name, ...)
+      else
+        return feed_inst (name, ...)
       end
-
-      compe ('Malformed line \'%s\'', line)
     end
 
-    local function feed_rstat (stat)
-      stat = stat:gsub ('^%s*', '')
-      stat = stat:gsub ('%s*$', '')
-      if (#stat > 0) then
+    local function feed_next (line, ...)
+      if (line ~= nil) then
+        linen = line
         seq = seq + 1
-        feed_stat (stat)
-      end
-    end
-
-    local function feed_chunk (chunk)
-      local stat, left = chunk:match ('([^:]+:)(.+)')
-      if (not stat) then
-        feed_rstat (chunk)
-      else
-        feed_rstat (stat)
-        feed_chunk (left)
+        feed_stat (...)
+        return true
       end
     end
 
     repeat
-      line = io.read ('*l')
-
-      if (line) then
-        line = line:gsub ('#.*$', '')
-        linen = linen + 1
-
-        for chunk in line:gmatch ('[^;]+') do
-          feed_chunk (chunk)
-        end
-      end
-    until (not line)
+    until (not feed_next (lexer:next ()))
+    unit.seqs = seq
   end
 return feed
 end
@@ -23,12 +23,6 @@
 #define _g_free0(var) ((var == NULL) ? NULL : (var = (g_free (var), NULL)))
 #define META "SmipsInst"
 
-static int __gc (lua_State* L)
-{
-  SmipsInst* self = luaL_checkudata (L, 1, META);
-return 0;
-}
-
 static int __index (lua_State* L)
 {
   size_t keysz;
@@ -140,17 +134,12 @@ typex (i, I_INST)
 typex (j, J_INST)
 #undef typex
 
-static int encode (lua_State* L)
+static guint pack (const SmipsInst* self)
 {
-  SmipsInst* self = luaL_checkudata (L, 1, META);
   guint inst = 0;
 
   switch (self->type)
   {
-    case MASK_INST:
-      luaL_error (L, "Please specify instruction type first");
-      break;
-
     case R_INST:
       inst |= (self->func & 0x3f) << 0;
       inst |= (self->shamt & 0x1f) << 6;
@@ -174,21 +163,68 @@ static int encode (lua_State* L)
       inst |= (self->constant & 0x3ffffff);
       break;
   }
-return (lua_pushinteger (L, inst), 1);
+return inst;
+}
+
+static int encode (lua_State* L)
+{
+  SmipsInst* self = luaL_checkudata (L, 1, META);
+
+  if (self->type == MASK_INST)
+    luaL_error (L, "Please specify instruction type first");
+return (lua_pushinteger (L, pack (self)), 1);
+}
+
+/*
+ * Packers encode straight from their arguments, without
+ * allocating an instruction object; the constant field
+ * is left for block fixups to patch
+ *
+ */
+
+static int packr (lua_State* L)
+{
+  SmipsInst inst = { R_INST, 0, };
+
+  inst.opcode = (guint) luaL_checkinteger (L, 1);
+  inst.rs = (guint) luaL_checkinteger (L, 2);
+  inst.rt = (guint) luaL_checkinteger (L, 3);
+  inst.rd = (guint) luaL_checkinteger (L, 4);
+  inst.shamt = (guint) luaL_checkinteger (L, 5);
+  inst.func = (guint) luaL_checkinteger (L, 6);
+return (lua_pushinteger (L, pack (&inst)), 1);
+}
+
+static int packi (lua_State* L)
+{
+  SmipsInst inst = { I_INST, 0, };
+
+  inst.opcode = (guint) luaL_checkinteger (L, 1);
+  inst.rs = (guint) luaL_checkinteger (L, 2);
+  inst.rt = (guint) luaL_checkinteger (L, 3);
+  inst.constant = (guint) luaL_optinteger (L, 4, 0);
+return (lua_pushinteger (L, pack (&inst)), 1);
+}
+
+static int packj (lua_State* L)
+{
+  SmipsInst inst = { J_INST, 0, };
+
+  inst.opcode = (guint) luaL_checkinteger (L, 1);
+  inst.constant = (guint) luaL_optinteger (L, 2, 0);
+return (lua_pushinteger (L, pack (&inst)), 1);
 }
 
 G_MODULE_EXPORT
 int luaopen_insts (lua_State* L)
 {
-  lua_createtable (L, 0, 5);
+  lua_createtable (L, 0, 8);
 
   luaL_newmetatable (L, META);
 #if LUA_VERSION_NUM < 503
   lua_pushliteral (L, META);
   lua_setfield (L, -2, "__name");
 #endif // LUA_VERSION_NUM
-  lua_pushcfunction (L, __gc);
-  lua_setfield (L, -2, "__gc");
   lua_pushvalue (L, -2);
   lua_pushcclosure (L, __index, 1);
   lua_setfield (L, -2, "__index");
@@ -206,5 +242,11 @@ int luaopen_insts (lua_State* L)
   lua_setfield (L, -2, "typej");
   lua_pushcfunction (L, encode);
   lua_setfield (L, -2, "encode");
+  lua_pushcfunction (L, packr);
+  lua_setfield (L, -2, "packr");
+  lua_pushcfunction (L, packi);
+  lua_setfield (L, -2, "packi");
+  lua_pushcfunction (L, packj);
+  lua_setfield (L, -2, "packj");
 return 1;
 }
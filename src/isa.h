@@ -0,0 +1,69 @@
+/* Copyright 2021-2025 MarcosHCK
+ * This file is part of SMIPS Assembler.
+ *
+ * SMIPS Assembler is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SMIPS Assembler is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with SMIPS Assembler. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef __SMIPS_ISA__
+#define __SMIPS_ISA__ 1
+#include <glib.h>
+#include <lua.h>
+#include <lauxlib.h>
+#include <luacmpt.h>
+
+typedef struct _SmipsIsaIndex SmipsIsaIndex;
+
+#if __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+enum
+{
+  ISA_REGISTER = 0,
+  ISA_RINST = 1,
+  ISA_IINST = 2,
+  ISA_JINST = 3,
+  ISA_MACRO = 4,
+};
+
+enum
+{
+  TAKES_RD = (1 << 0),
+  TAKES_RS = (1 << 1),
+  TAKES_RT = (1 << 2),
+  TAKES_SHAMT = (1 << 3),
+  TAKES_CS = (1 << 4),
+  TAKES_RS_FIRST = (1 << 5),
+};
+
+struct _SmipsIsaIndex
+{
+  int name;
+  int kind;
+  guint reg;
+  guint opcode;
+  guint func;
+  guint takes;
+  gchar tagable;
+  gchar address;
+};
+
+G_GNUC_INTERNAL const SmipsIsaIndex* _smips_isa_index_lookup (const char *str, size_t len);
+G_GNUC_INTERNAL void _smips_isa_push (lua_State* L, const SmipsIsaIndex* index, const gchar* name, gsize namesz);
+
+#if __cplusplus
+}
+#endif // __cplusplus
+
+#endif // __SMIPS_ISA__
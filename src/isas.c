@@ -0,0 +1,134 @@
+/* Copyright 2021-2025 MarcosHCK
+ * This file is part of SMIPS Assembler.
+ *
+ * SMIPS Assembler is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SMIPS Assembler is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with SMIPS Assembler. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <config.h>
+#include <gmodule.h>
+#include <isa.h>
+
+#define CACHE "SmipsIsa"
+
+static void _build (lua_State* L, const SmipsIsaIndex* index, const gchar* name, gsize namesz)
+{
+  static const gchar* types [] = { NULL, "r", "i", "j", "macro", };
+  const gchar tagable [] = { index->tagable, '\0' };
+  const gchar address [] = { index->address, '\0' };
+
+  lua_createtable (L, 0, 7);
+  lua_pushlstring (L, name, namesz);
+  lua_setfield (L, -2, "name");
+  lua_pushstring (L, types [index->kind]);
+  lua_setfield (L, -2, "type");
+  lua_pushinteger (L, index->opcode);
+  lua_setfield (L, -2, "opcode");
+
+  if (index->kind == ISA_RINST)
+  {
+    lua_pushinteger (L, index->func);
+    lua_setfield (L, -2, "func");
+  }
+
+  if (index->tagable != 0)
+  {
+    lua_pushstring (L, tagable);
+    lua_setfield (L, -2, "tagable");
+  }
+
+  if (index->address != 0)
+  {
+    lua_pushstring (L, address);
+    lua_setfield (L, -2, "address");
+  }
+
+  lua_createtable (L, 0, 6);
+#define takes(flag,name) \
+  G_STMT_START { \
+    lua_pushboolean (L, (index->takes & (flag)) != 0); \
+    lua_setfield (L, -2, (name)); \
+  } G_STMT_END
+  takes (TAKES_RD, "rd");
+  takes (TAKES_RS, "rs");
+  takes (TAKES_RT, "rt");
+  takes (TAKES_SHAMT, "shamt");
+  takes (TAKES_CS, "cs");
+  takes (TAKES_RS_FIRST, "rs_first");
+#undef takes
+  lua_setfield (L, -2, "takes");
+}
+
+void _smips_isa_push (lua_State* L, const SmipsIsaIndex* index, const gchar* name, gsize namesz)
+{
+  g_assert (index->kind != ISA_REGISTER);
+  luaL_checkstack (L, 4, "isa descriptor");
+#if LUA_VERSION_NUM >= 502
+  luaL_getmetatable (L, CACHE);
+#else // LUA_VERSION_NUM < 502
+  lua_getfield (L, LUA_REGISTRYINDEX, CACHE);
+#endif // LUA_VERSION_NUM
+  lua_pushlightuserdata (L, (gpointer) index);
+  lua_rawget (L, -2);
+
+  if (lua_isnil (L, -1))
+  {
+    lua_pop (L, 1);
+    _build (L, index, name, namesz);
+    lua_pushlightuserdata (L, (gpointer) index);
+    lua_pushvalue (L, -2);
+    lua_rawset (L, -4);
+  }
+
+  lua_remove (L, -2);
+}
+
+static int lookup (lua_State* L)
+{
+  size_t namesz;
+  const gchar* name = luaL_checklstring (L, 1, &namesz);
+  const SmipsIsaIndex* index = NULL;
+
+  if ((index = _smips_isa_index_lookup (name, namesz)) == NULL || index->kind == ISA_REGISTER)
+    lua_pushnil (L);
+  else
+    _smips_isa_push (L, index, name, namesz);
+return 1;
+}
+
+static int _register (lua_State* L)
+{
+  size_t namesz;
+  const gchar* name = luaL_checklstring (L, 1, &namesz);
+  const SmipsIsaIndex* index = NULL;
+
+  if ((index = _smips_isa_index_lookup (name, namesz)) == NULL || index->kind != ISA_REGISTER)
+    lua_pushnil (L);
+  else
+    lua_pushinteger (L, index->reg);
+return 1;
+}
+
+G_MODULE_EXPORT
+int luaopen_isas (lua_State* L)
+{
+  luaL_newmetatable (L, CACHE);
+  lua_pop (L, 1);
+
+  lua_createtable (L, 0, 2);
+  lua_pushcfunction (L, lookup);
+  lua_setfield (L, -2, "lookup");
+  lua_pushcfunction (L, _register);
+  lua_setfield (L, -2, "register");
+return 1;
+}
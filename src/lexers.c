@@ -0,0 +1,589 @@
+/* Copyright 2021-2025 MarcosHCK
+ * This file is part of SMIPS Assembler.
+ *
+ * SMIPS Assembler is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SMIPS Assembler is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with SMIPS Assembler. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <config.h>
+#include <gmodule.h>
+#include <isa.h>
+#include <log.h>
+#include <stdio.h>
+
+typedef struct _SmipsLexer SmipsLexer;
+typedef struct _SmipsStat SmipsStat;
+typedef struct _SmipsToken SmipsToken;
+#define _g_free0(var) ((var == NULL) ? NULL : (var = (g_free (var), NULL)))
+#define META "SmipsLexer"
+#define BUFSZ (1 << 20)
+
+#define isblank_(c) ((c) == ' ' || (c) == '\t' || (c) == '\r' || (c) == '\v' || (c) == '\f')
+#define isterm(c) ((c) == '\n' || (c) == ';' || (c) == '#')
+
+enum
+{
+  STAT_TAG,
+  STAT_LOCAL,
+  STAT_DIRECTIVE,
+  STAT_INST,
+  STAT_MALFORMED,
+};
+
+enum
+{
+  TOKEN_OPERAND,
+  TOKEN_REGISTER,
+};
+
+struct _SmipsToken
+{
+  int type;
+  const gchar* start;
+  gsize length;
+  const SmipsIsaIndex* index;
+};
+
+struct _SmipsStat
+{
+  int kind;
+  guint line;
+  const gchar* name;
+  gsize namesz;
+  const SmipsIsaIndex* index;
+  guint first;
+  guint count;
+};
+
+struct _SmipsLexer
+{
+  GBytes* bytes;
+  gchar* source;
+  gchar* path;
+  const gchar* cursor;
+  const gchar* end;
+  guint line;
+  GArray* tokens;
+
+  /* prefetched lexers only */
+  GArray* stats;
+  GError* error;
+  guint next;
+};
+
+/*
+ * Scanner
+ *
+ */
+
+static const gchar* skipstring (const gchar* p, const gchar* end)
+{
+  const gchar quote = *p++;
+
+  while (p < end && *p != quote && *p != '\n')
+  {
+    if (*p == '\\' && p + 1 < end && p [1] != '\n')
+      p += 2;
+    else
+      p += 1;
+  }
+return (p < end && *p == quote) ? p + 1 : p;
+}
+
+static const gchar* skipstat (const gchar* p, const gchar* end)
+{
+  while (p < end && !isterm (*p))
+  {
+    if (*p == '\"' || *p == '\'')
+      p = skipstring (p, end);
+    else
+      p += 1;
+  }
+return p;
+}
+
+static const gchar* trimback (const gchar* start, const gchar* p)
+{
+  while (p > start && isblank_ (p [-1]))
+    --p;
+return p;
+}
+
+static int isregister (const gchar* start, gsize length)
+{
+  gsize i;
+
+  if (length < 2 || start [0] != '$')
+    return FALSE;
+
+  for (i = 1; i < length; i++)
+  {
+    if (!g_ascii_isdigit (start [i]) && !g_ascii_islower (start [i]))
+      return FALSE;
+  }
+return TRUE;
+}
+
+static int scan (SmipsLexer* self, SmipsStat* stat)
+{
+  const gchar* end = self->end;
+  const gchar* p = self->cursor;
+  const gchar* start = NULL;
+  gboolean lower = TRUE;
+  int depth;
+
+  stat->first = self->tokens->len;
+  stat->count = 0;
+  stat->index = NULL;
+
+  while (TRUE)
+  {
+    if (p >= end)
+    {
+      self->cursor = p;
+      return 0;
+    }
+    else if (*p == '\n')
+    {
+      self->line++;
+      p++;
+    }
+    else if (*p == '#')
+    {
+      while (p < end && *p != '\n')
+        p++;
+    }
+    else if (*p == ';' || isblank_ (*p))
+      p++;
+    else
+      break;
+  }
+
+  stat->line = self->line;
+  stat->name = start = p;
+
+  if (g_ascii_isdigit (*p))
+  {
+    while (p < end && g_ascii_isdigit (*p))
+      p++;
+
+    if (p >= end || *p != ':')
+      goto malformed;
+
+    stat->kind = STAT_LOCAL;
+    stat->namesz = p - start;
+    self->cursor = p + 1;
+    return 1;
+  }
+  else if (*p == '.')
+  {
+    stat->kind = STAT_DIRECTIVE;
+    stat->name = ++p;
+
+    while (p < end && g_ascii_islower (*p))
+      p++;
+    if (p == stat->name)
+      goto malformed;
+  }
+  else if (g_ascii_isalpha (*p) || *p == '_')
+  {
+    while (p < end && (g_ascii_isalnum (*p) || *p == '_'))
+    {
+      lower = lower && g_ascii_islower (*p);
+      p++;
+    }
+
+    if (p < end && *p == ':')
+    {
+      stat->kind = STAT_TAG;
+      stat->namesz = p - start;
+      self->cursor = p + 1;
+      return 1;
+    }
+
+    if (!lower)
+      goto malformed;
+
+    stat->kind = STAT_INST;
+    stat->index = _smips_isa_index_lookup (start, p - start);
+
+    if (stat->index != NULL && stat->index->kind == ISA_REGISTER)
+      stat->index = NULL;
+  }
+  else
+  {
+    goto malformed;
+  }
+
+  stat->namesz = p - stat->name;
+
+  if (p < end && !isterm (*p) && !isblank_ (*p))
+    goto malformed;
+  while (p < end && isblank_ (*p))
+    p++;
+
+  if (p < end && !isterm (*p))
+  {
+    while (TRUE)
+    {
+      SmipsToken token = {0};
+      token.start = p;
+      depth = 0;
+
+      while (p < end && !isterm (*p) && (*p != ',' || depth > 0))
+      {
+        switch (*p)
+        {
+          case '\"':
+          case '\'':
+            p = skipstring (p, end);
+            continue;
+          case '(':
+          case '[':
+          case '{':
+            ++depth;
+            break;
+          case ')':
+          case ']':
+          case '}':
+            if (depth > 0)
+              --depth;
+            break;
+        }
+
+        p++;
+      }
+
+      token.length = trimback (token.start, p) - token.start;
+
+      if (token.length == 0)
+        goto malformed;
+      if (!isregister (token.start, token.length))
+        token.type = TOKEN_OPERAND;
+      else
+      {
+        token.type = TOKEN_REGISTER;
+        token.index = _smips_isa_index_lookup (token.start + 1, token.length - 1);
+
+        if (token.index != NULL && token.index->kind != ISA_REGISTER)
+          token.index = NULL;
+      }
+
+      g_array_append_val (self->tokens, token);
+      stat->count++;
+
+      if (p >= end || *p != ',')
+        break;
+
+      do ++p; while (p < end && isblank_ (*p));
+    }
+  }
+
+  self->cursor = p;
+return 1;
+
+malformed:
+  g_array_set_size (self->tokens, stat->first);
+  p = skipstat (start, end);
+  stat->kind = STAT_MALFORMED;
+  stat->count = 0;
+  stat->name = start;
+  stat->namesz = trimback (start, p) - start;
+  self->cursor = p;
+return -1;
+}
+
+/*
+ * Lua API
+ *
+ */
+
+static int __gc (lua_State* L)
+{
+  SmipsLexer* self = luaL_checkudata (L, 1, META);
+  g_clear_pointer (&self->bytes, g_bytes_unref);
+  g_clear_pointer (&self->tokens, g_array_unref);
+  g_clear_pointer (&self->stats, g_array_unref);
+  g_clear_error (&self->error);
+  _g_free0 (self->source);
+  _g_free0 (self->path);
+return 0;
+}
+
+static SmipsLexer* _alloc (lua_State* L, const gchar* path, const gchar* source)
+{
+  const gsize sz = sizeof (SmipsLexer);
+  SmipsLexer* self = NULL;
+
+  self = lua_newuserdata (L, sz);
+  memset (self, 0, sz);
+#if LUA_VERSION_NUM >= 502
+  luaL_setmetatable (L, META);
+#else // LUA_VERSION_NUM < 502
+  lua_getfield (L, LUA_REGISTRYINDEX, META);
+  lua_setmetatable (L, -2);
+#endif // LUA_VERSION_NUM
+
+  self->path = g_strdup (path);
+  self->source = g_strdup (source);
+  self->tokens = g_array_new (FALSE, FALSE, sizeof (SmipsToken));
+return self;
+}
+
+static void _attach (SmipsLexer* self, GBytes* bytes)
+{
+  gsize size = 0;
+
+  self->bytes = bytes;
+  self->cursor = g_bytes_get_data (self->bytes, &size);
+  self->end = self->cursor + size;
+  self->line = 1;
+}
+
+static GBytes* _slurp (FILE* file, GError** error)
+{
+  GByteArray* array = NULL;
+  gsize read, size = 0;
+
+  array = g_byte_array_sized_new (BUFSZ);
+
+  do
+  {
+    g_byte_array_set_size (array, size + BUFSZ);
+    read = fread (array->data + size, 1, BUFSZ, file);
+    size += read;
+  }
+  while (read == BUFSZ);
+
+  g_byte_array_set_size (array, size);
+
+  if (G_UNLIKELY (ferror (file)))
+  {
+    g_byte_array_unref (array);
+    g_set_error_literal (error, G_FILE_ERROR, G_FILE_ERROR_IO, "Failed reading standard input");
+    return NULL;
+  }
+return g_byte_array_free_to_bytes (array);
+}
+
+static GBytes* _load (const gchar* path, GError** error)
+{
+  GMappedFile* mapped = NULL;
+  GBytes* bytes = NULL;
+
+  if (strcmp (path, "-") == 0)
+    return _slurp (stdin, error);
+  if ((mapped = g_mapped_file_new (path, FALSE, error)) == NULL)
+    return NULL;
+
+  bytes = g_mapped_file_get_bytes (mapped);
+  g_mapped_file_unref (mapped);
+return bytes;
+}
+
+static const gchar* _source (const gchar* path)
+{
+return (strcmp (path, "-") == 0) ? "(stdin)" : path;
+}
+
+static void _prefetch_one (gpointer data, gpointer user_data)
+{
+  SmipsLexer* self = data;
+  GBytes* bytes = NULL;
+  SmipsStat stat = {0};
+  int result;
+
+  if ((bytes = _load (self->path, &self->error)) != NULL)
+  {
+    _attach (self, bytes);
+    self->stats = g_array_new (FALSE, FALSE, sizeof (SmipsStat));
+
+    while ((result = scan (self, &stat)) != 0)
+    {
+      g_array_append_val (self->stats, stat);
+
+      if (result < 0)
+        break;
+    }
+  }
+}
+
+static int _new (lua_State* L)
+{
+  size_t size;
+  const gchar* input = luaL_checklstring (L, 1, &size);
+  const gchar* source = luaL_checkstring (L, 2);
+  SmipsLexer* self = NULL;
+
+  self = _alloc (L, NULL, source);
+  _attach (self, g_bytes_new (input, size));
+return 1;
+}
+
+static int _open (lua_State* L)
+{
+  const gchar* path = luaL_checkstring (L, 1);
+  const gchar* source = luaL_optstring (L, 2, _source (path));
+  SmipsLexer* self = NULL;
+  GError* tmperr = NULL;
+  GBytes* bytes = NULL;
+
+  self = _alloc (L, path, source);
+
+  if ((bytes = _load (path, &tmperr)) == NULL)
+    _smips_log_gerror (L, 1, tmperr);
+
+  _attach (self, bytes);
+return 1;
+}
+
+static int _prefetch (lua_State* L)
+{
+  const int jobs = luaL_checkinteger (L, 1);
+  GThreadPool* pool = NULL;
+  GError* tmperr = NULL;
+  const gchar* path = NULL;
+  SmipsLexer** lexers = NULL;
+  int i, count;
+
+  luaL_argcheck (L, jobs > 0, 1, "expected a positive number of jobs");
+  luaL_checktype (L, 2, LUA_TTABLE);
+#if LUA_VERSION_NUM >= 502
+  count = (int) lua_rawlen (L, 2);
+#else // LUA_VERSION_NUM < 502
+  count = (int) lua_objlen (L, 2);
+#endif // LUA_VERSION_NUM
+
+  lua_createtable (L, count, 0);
+  lexers = lua_newuserdata (L, sizeof (SmipsLexer*) * (count + 1));
+
+  for (i = 0; i < count; i++)
+  {
+    lua_rawgeti (L, 2, i + 1);
+
+    if ((path = lua_tostring (L, -1)) == NULL)
+    {
+      const gchar* typename = luaL_typename (L, -1);
+      const gchar* message = lua_pushfstring (L, "expected string at index %d, got %s", i + 1, typename);
+        luaL_argerror (L, 2, message);
+    }
+
+    lexers [i] = _alloc (L, path, _source (path));
+    lua_rawseti (L, -4, i + 1);
+    lua_pop (L, 1);
+  }
+
+  if ((pool = g_thread_pool_new (_prefetch_one, NULL, jobs, FALSE, &tmperr)) == NULL)
+    _smips_log_gerror (L, 0, tmperr);
+
+  for (i = 0; i < count; i++)
+  {
+    if (!g_thread_pool_push (pool, lexers [i], &tmperr))
+    {
+      g_thread_pool_free (pool, FALSE, TRUE);
+      _smips_log_gerror (L, 0, tmperr);
+    }
+  }
+
+  g_thread_pool_free (pool, FALSE, TRUE);
+  lua_pop (L, 1);
+return 1;
+}
+
+static int next (lua_State* L)
+{
+  static const gchar* kinds [] = { "tag", "local", "directive", "inst", };
+  SmipsLexer* self = luaL_checkudata (L, 1, META);
+  const SmipsToken* token = NULL;
+  SmipsStat stat = {0};
+  GError* error = NULL;
+  int result;
+  guint i;
+
+  if (self->stats == NULL && self->error == NULL)
+  {
+    g_array_set_size (self->tokens, 0);
+    result = scan (self, &stat);
+  }
+  else if (self->error != NULL)
+  {
+    error = self->error;
+    self->error = NULL;
+    _smips_log_gerror (L, 1, error);
+  }
+  else if (self->next >= self->stats->len)
+    result = 0;
+  else
+  {
+    stat = g_array_index (self->stats, SmipsStat, self->next++);
+    result = (stat.kind == STAT_MALFORMED) ? -1 : 1;
+  }
+
+  if (result == 0)
+    return 0;
+  else if (result < 0)
+  {
+    const gchar* line = (lua_pushlstring (L, stat.name, stat.namesz), lua_tostring (L, -1));
+    const gchar* message = lua_pushfstring (L, "%s: %d: Malformed line '%s'", self->source, (int) stat.line, line);
+    _smips_log_lerror (L, 1, message);
+  }
+
+  lua_settop (L, 1);
+  luaL_checkstack (L, stat.count + 3, "too many operands");
+  lua_pushinteger (L, stat.line);
+  lua_pushstring (L, kinds [stat.kind]);
+
+  if (stat.index == NULL)
+    lua_pushlstring (L, stat.name, stat.namesz);
+  else
+    _smips_isa_push (L, stat.index, stat.name, stat.namesz);
+
+  for (i = 0; i < stat.count; i++)
+  {
+    token = & g_array_index (self->tokens, SmipsToken, stat.first + i);
+
+    if (token->type != TOKEN_REGISTER || stat.kind != STAT_INST)
+      lua_pushlstring (L, token->start, token->length);
+    else if (token->index != NULL)
+      lua_pushinteger (L, token->index->reg);
+    else
+      lua_pushlstring (L, token->start, token->length);
+  }
+return lua_gettop (L) - 1;
+}
+
+G_MODULE_EXPORT
+int luaopen_lexers (lua_State* L)
+{
+  lua_createtable (L, 0, 4);
+  luaL_newmetatable (L, META);
+#if LUA_VERSION_NUM < 503
+  lua_pushliteral (L, META);
+  lua_setfield (L, -2, "__name");
+#endif // LUA_VERSION_NUM
+  lua_pushcfunction (L, __gc);
+  lua_setfield (L, -2, "__gc");
+  lua_pushvalue (L, -2);
+  lua_setfield (L, -2, "__index");
+  lua_pop (L, 1);
+
+  lua_pushcfunction (L, _new);
+  lua_setfield (L, -2, "new");
+  lua_pushcfunction (L, _open);
+  lua_setfield (L, -2, "open");
+  lua_pushcfunction (L, _prefetch);
+  lua_setfield (L, -2, "prefetch");
+  lua_pushcfunction (L, next);
+  lua_setfield (L, -2, "next");
+return 1;
+}
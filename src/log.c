@@ -146,8 +146,10 @@ int luaopen_log (lua_State* L)
 #endif // LUA_VERSION_NUM
   lua_pop (L, 1);
 
-  lua_createtable (L, 0, 1);
+  lua_createtable (L, 0, 2);
   lua_pushcfunction (L, _error);
   lua_setfield (L, -2, "error");
+  lua_pushcfunction (L, _smips_msgh);
+  lua_setfield (L, -2, "handler");
 return 1;
 }
@@ -41,6 +41,9 @@ static int _getopt (lua_State* L)
   {
     switch (opt->type)
     {
+      case G_OPTION_ARG_NONE:
+        lua_pushboolean (L, G_STRUCT_MEMBER (gboolean, self, opt->offset));
+        break;
       case G_OPTION_ARG_INT:
         lua_pushinteger (L, G_STRUCT_MEMBER (gint, self, opt->offset));
         break;
@@ -115,13 +118,27 @@ static int _parse (lua_State* L)
     }
   }
 
+  self->cache = NULL;
+  self->format = NULL;
   self->split = NULL;
   self->output = NULL;
+  self->jobs = 0;
+  self->watch = FALSE;
+  self->compile = FALSE;
+  self->link = FALSE;
+  self->stream = FALSE;
 
   GOptionEntry entries [] =
   {
+    { "cache", 0, 0, G_OPTION_ARG_FILENAME, & self->cache, "Keep parsed input files in DIR and reuse them while unchanged", "DIR", },
+    { "compile", 'c', 0, G_OPTION_ARG_NONE, & self->compile, "Only assemble each input file into a relocatable object", NULL, },
+    { "format", 0, 0, G_OPTION_ARG_STRING, & self->format, "Write banks as FORMAT: raw (default), bin, elf, readmemh, readmemb, coe or mif", "FORMAT", },
+    { "jobs", 'j', 0, G_OPTION_ARG_INT, & self->jobs, "Read and scan input files using N parallel jobs", "N", },
+    { "link", 0, 0, G_OPTION_ARG_NONE, & self->link, "Link relocatable objects instead of assembling sources", NULL, },
     { "output", 'o', 0, G_OPTION_ARG_FILENAME, & self->output, "Place output in FILE", "FILE", },
     { "split", 's', 0, G_OPTION_ARG_STRING, & self->split, "Split bank into separate banks named GROUP", "GROUP" },
+    { "stream", 0, 0, G_OPTION_ARG_NONE, & self->stream, "Assemble in two passes over the sources, without keeping the program in memory", NULL, },
+    { "watch", 'w', 0, G_OPTION_ARG_NONE, & self->watch, "Keep running and reassemble whenever an input file changes", NULL, },
     G_OPTION_ENTRY_NULL,
   };
 
@@ -30,8 +30,15 @@ extern "C" {
 
 struct _SmipsOptions
 {
+  const gchar* cache;
+  const gchar* format;
   const gchar* output;
   const gchar* split;
+  gint jobs;
+  gboolean watch;
+  gboolean compile;
+  gboolean link;
+  gboolean stream;
 };
 
 #if __cplusplus
@@ -15,55 +15,14 @@
 --  You should have received a copy of the GNU General Public License
 --  along with SMIPS Assembler.  If not, see <http://www.gnu.org/licenses/>.
 ]]
+local exprs = require ('exprs')
+local isa = require ('isa')
 local log = require ('log')
 local tags = require ('tags')
+local units = require ('unit')
 
 do
-  local function getlocalf (locals, seq)
-    local top = locals:length () - 1
-    local pos = 0
-    local max
-
-    repeat
-      if (pos > top) then
-        break
-      else
-        local half = math.floor (pos + top)
-        local loc = locals [half + 1]
-
-        if (loc.seq > seq) then
-          top = half - 1
-          max = loc
-        else
-          pos = half + 1
-        end
-      end
-    until (false)
-  return max
-  end
-
-  local function getlocalb (locals, seq)
-    local top = locals:length () - 1
-    local pos = 0
-    local min
-
-    repeat
-      if (pos > top) then
-        break
-      else
-        local half = math.floor (pos + top)
-        local loc = locals [half + 1]
-
-        if (loc.seq > seq) then
-          top = half - 1
-        else
-          pos = half + 1
-          min = loc
-        end
-      end
-    until (false)
-  return min
-  end
+  local localpattern = '%f[%w_]([0-9]+)([bf])%f[^%w_]'
 
   local function process (unit)
     local source, linen, seq
@@ -84,47 +43,50 @@ do
       log.error (collect ('%s: %s', where, literal))
     end
 
-    local function sublocal (name, direction)
-      local alias = tonumber (name)
-      local locals = unit.locals [alias]
+    local env = { _ = offset, tonumber = tonumber, tostring = tostring, }
+    local arena = tags.arena ()
+    local symtags = {}
+    local cache = {}
+    local findlocal = units.resolver (unit.locals)
 
-      if (not locals) then
-        compe ('Undefined local tag \'%i%s\'', alias, direction)
-      else
-          assert (seq ~= nil, 'Fix this!')
-        local func = (direction == 'f') and getlocalf or getlocalb
-        local loc = func (locals, seq)
+    local function symtag (key)
+      local tag = symtags [key]
 
-        if (loc) then
-          return loc.tagname
-        else
-          compe ('Undefined local tag \'%i%s\'', alias, direction)
+      if (tag == nil) then
+        local value = unit.symbols:lookup (key)
+
+        if (value ~= nil) then
+          tag = arena:rel (value)
+          symtags [key] = tag
         end
       end
+    return tag
     end
 
-    local function expression (expr)
-      local env, mt, reason
-      local chunk, result
+    -- Expressions call this for every 'Nb' or 'Nf' reference,
+    -- it resolves against the sequence of the current entry
+    function env.__local (alias, direction)
+        assert (seq ~= nil, 'Fix this!')
+      local loc = findlocal (alias, direction, seq)
 
-      env =
-      {
-        _ = offset,
-        tonumber = tonumber,
-        tostring = tostring,
-        math = setmetatable ({}, { __mode = 'protected', __index = _G.math, }),
-        string = setmetatable ({}, { __mode = 'protected', __index = _G.string, }),
-      }
+      if (loc) then
+        return symtag (loc.id)
+      else
+        compe ('Undefined local tag \'%i%s\'', alias, direction)
+      end
+    end
+
+    do
+      env.math = setmetatable ({}, { __mode = 'protected', __index = _G.math, })
+      env.string = setmetatable ({}, { __mode = 'protected', __index = _G.string, })
 
-      mt =
+      local mt =
       {
         __index = function (self, key)
-          local tags = unit.tags
-          if (tags [key]) then
-            return tags [key]
-          elseif (key:find ('^[0-9]')) then
-            -- Local tag
-            error ('unimplemented')
+          local tag = symtag (key)
+
+          if (tag ~= nil) then
+            return tag
           else
             compe ('Undefined tag \'%s\'', key)
           end
@@ -132,150 +94,204 @@ do
       }
 
       setmetatable (env, mt)
+    end
 
-      expr = expr:gsub ('([0-9]+)([b|f])', sublocal)
-      expr = ('do return %s; end'):format (expr)
-      chunk, reason = load (expr, '=expression', 't', env)
-      if (not chunk) then
-        compe (reason)
+    local function compile (expr)
+      local value = exprs.eval (expr)
+
+      if (value ~= nil) then
+        return function () return value end
       else
-        return (chunk ())
+        local code = ('do return %s; end'):format (expr)
+        local chunk, reason = load (code, '=expression', 't', env)
+
+        if (not chunk) then
+          compe (reason)
+        else
+          return chunk
+        end
       end
     end
 
-    local function calculate (tag)
-      checkArg (1, tag, 'SmipsTag')
-
-      local type, subtype = tag:type ()
-      if (type == 'value') then
-        if (subtype == 'absolute') then
-          return tag.value
-        elseif (subtype == 'relative') then
-          local block = unit.block
-          local idx = tag.value
-          local at = block [idx]
-          return at.offset + at.size
+    -- Operands read from relocatable objects are fixup programs
+    -- (see unit.lua), replayed here over tags without loading
+    -- any code; '//' is not even syntax before Lua 5.3, so tags
+    -- are divided through their own metamethod
+    local operations =
+    {
+      unm = function (a) return -a end,
+      add = function (a, b) return a + b end,
+      sub = function (a, b) return a - b end,
+      mul = function (a, b) return a * b end,
+      div = function (a, b) return a / b end,
+      mod = function (a, b) return a % b end,
+      idiv = function (a, b)
+        local mt = getmetatable (a) or getmetatable (b)
+
+        if (mt ~= nil and mt.__idiv ~= nil) then
+          return mt.__idiv (a, b)
         else
-          error ('Unknown type ' .. subtype)
+          return (a - a % b) / b
         end
-      else
-        local left = tag.left
-        local right = tag.right
-
-        if (subtype == 'add') then
-          return calculate (left) + calculate (right)
-        elseif (subtype == 'sub') then
-          return calculate (left) - calculate (right)
-        elseif (subtype == 'mul') then
-          return calculate (left) * calculate (right)
-        elseif (subtype == 'div') then
-          return calculate (left) / calculate (right)
-        elseif (subtype == 'mod') then
-          return calculate (left) % calculate (right)
-        elseif (subtype == 'unm') then
-          return -calculate (left)
+      end,
+    }
+
+    local function replay (prog)
+      local stack, top, i = {}, 0, 1
+
+      while (i <= #prog) do
+        local op = prog [i]
+
+        if (op == 'const' or op == 'string') then
+          top = top + 1
+          stack [top] = prog [i + 1]
+          i = i + 2
+        elseif (op == 'symbol') then
+          top = top + 1
+          stack [top] = symtag (prog [i + 1]) or compe ('Undefined tag \'%s\'', prog [i + 1])
+          i = i + 2
+        elseif (op == 'local') then
+          top = top + 1
+          stack [top] = env.__local (prog [i + 1], prog [i + 2])
+          i = i + 3
+        elseif (op == 'here') then
+          top = top + 1
+          stack [top] = offset
+          i = i + 1
         else
-          error ('Unknown operation ' .. subtype)
+          local ok, value
+
+          if (op == 'unm') then
+            ok, value = pcall (operations.unm, stack [top])
+          else
+            top = top - 1
+            ok, value = pcall (operations [op], stack [top], stack [top + 1])
+          end
+
+          if (not ok) then
+            compe (tostring (value))
+          end
+
+          stack [top] = value
+          i = i + 1
         end
       end
+    return stack [1]
+    end
+
+    local function expression (expr)
+      local chunk = cache [expr]
+
+      if (chunk == nil) then
+        chunk = compile ((expr:gsub (localpattern, '__local (%1, \'%2\')')))
+        cache [expr] = chunk
+      end
+
+      env._ = offset
+    return (chunk ())
     end
 
-    for i, ent in ipairs (unit.block) do
-      if (not ent.loc) then
+    local block = unit.block
+    local consts = {}
+    local delays = {}
+
+    local function locate (i)
+      source, linen = block:where (i)
+
+      if (source == nil) then
         source = '?'
         linen = -1
-      else
-        source = ent.loc.source
-        linen = ent.loc.line
       end
+    end
 
-      seq = ent.seq
-
-      if (ent.inst ~= nil) then
-        local inst = ent.inst
-        local cs = ent.extra [1]
-        local style = ent.extra [2]
-
-        if (cs) then
-          local const = expression (cs)
-          if (pcall (checkArg, 1, const, 'SmipsTag')) then
-            if (style == 'r') then
-              ent.const = ((const - tags.rel (i - 1)) / 4) - 1
-            elseif (style == 'j') then
-              ent.const = const / 4
-            elseif (style == 'a') then
-              ent.const = const
-            else
-              compe ('Non tagable instruction')
-            end
-          elseif (type (const) == 'number') then
-            if (style == 'r') then
-              ent.const = ((const - tags.rel (i - 1)) / 4) - 1
-            else
-              inst.constant = const
-            end
-          elseif (type (const) == 'string') then
-            if (#const < 5) then
-              inst.constant = const:byte (1, #const)
-            else
-              compe ('Data too big to fit into a register')
-            end
-          else
-            compe ('Value should be constant number')
-          end
+    for i = 1, block:length () do
+      local kind, size, operand, style
+
+      locate (i)
+      kind, size, operand, style, seq = block:get (i)
+
+      if (kind == 'delay') then
+        local trans = isa.transforms [style]
+        local val
+          assert (trans)
+
+        if (type (operand) == 'table') then
+          val = replay (operand)
+        else
+          val = expression (operand)
+        end
+
+        if (pcall (checkArg, 1, val, 'SmipsTag')) then
+          table.insert (delays, { i, val, trans, })
+        else
+          block:fill (i, trans (val, compe))
         end
-      elseif (ent.data) then
-        local size = #ent.data
-        local mis = size % 4
-        local cors = mis > 0 and 4 - mis or 0
-        local corz = (string.char (0)):rep (cors)
-          ent.size = size + cors
-          ent.data = ent.data .. corz
-      elseif (ent.size) then
-        if (not ent.extra) then
-          local size = ent.size
-          local char = string.char (0)
-          local data = char:rep (size)
-            ent.data = data
+      elseif (kind == 'org') then
+        if (operand < offset) then
+          compe ('Can not move location backwards to 0x%x', operand)
+        else
+          size = operand - offset
+          block:resize (i, size)
+        end
+      elseif (kind ~= 'data' and kind ~= 'zero' and operand ~= nil) then
+        local const
+
+        if (type (operand) == 'table') then
+          const = replay (operand)
         else
-          local arg = ent.extra [1]
-          local trans = ent.extra [2]
-          local val = expression (arg)
-            assert (trans)
-
-          if (pcall (checkArg, 1, val, 'SmipsTag')) then
-            ent.delay = val
-            ent.trans = trans
+          const = (type (operand) == 'number') and symtag (operand) or expression (operand)
+        end
+
+        if (pcall (checkArg, 1, const, 'SmipsTag')) then
+          if (style == 'r') then
+            consts [i] = ((const - arena:rel (i - 1)) / 4) - 1
+          elseif (style == 'j') then
+            consts [i] = const / 4
+          elseif (style == 'a') then
+            consts [i] = const
+          else
+            compe ('Non tagable instruction')
+          end
+        elseif (type (const) == 'number') then
+          if (style == 'r') then
+            consts [i] = ((const - arena:rel (i - 1)) / 4) - 1
+          else
+            block:patch (i, const)
+          end
+        elseif (type (const) == 'string') then
+          if (#const < 5) then
+            block:patch (i, const:byte (1, #const))
           else
-            ent.data = trans (val)
+            compe ('Data too big to fit into a register')
           end
+        else
+          compe ('Value should be constant number')
         end
       end
 
-      ent.offset = offset
-      offset = offset + ent.size
+      block:place (i, offset)
+      offset = offset + size
     end
 
-    for _, ent in ipairs (unit.block) do
-      if (not ent.loc) then
-        source = '?'
-        linen = -1
-      else
-        source = ent.loc.source
-        linen = ent.loc.line
-      end
+    -- instructions are patched off the Lua state, delayed
+    -- data still goes through its Lua transform
+    do
+      local ok, reason, i = tags.resolve (block, consts)
 
-      if (ent.const) then
-        local tag = ent.const
-        local inst = ent.inst
-        inst.constant = calculate (tag)
-      elseif (ent.delay) then
-        local trans = ent.trans
-        local tag = ent.delay
-        local val = calculate (tag)
-          ent.data = trans (val)
+      if (not ok) then
+        locate (i)
+        compe (reason)
       end
     end
+
+    for _, delay in ipairs (delays) do
+      local i = delay [1]
+      locate (i)
+      block:fill (i, delay [3] (tags.evaluate (delay [2], block), compe))
+    end
+
+    -- every tag built above goes away at once
+    arena:release ()
   end
 return process
 end
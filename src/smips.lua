@@ -16,25 +16,20 @@
 --  along with SMIPS Assembler.  If not, see <http://www.gnu.org/licenses/>.
 ]]
 local banks = require ('banks')
+local caches = require ('caches')
 local feed = require ('feed')
+local lexers = require ('lexers')
+local log = require ('log')
 local opt = require ('options')
 local process = require ('process')
 local splitters = require ('splitters')
+local streams = require ('stream')
 local units = require ('unit')
 local utils = require ('utils')
+local watchers = require ('watchers')
 
 do
-  local function printout (unit, bank)
-    for _, ent in ipairs (unit.block) do
-      if (ent.inst) then
-        bank:emit32 (ent.inst:encode ())
-      elseif (ent.data) then
-        bank:emits (ent.data)
-      elseif (ent.size) then
-        bank:zero (ent.size)
-      end
-    end
-
+  local function finish (bank)
     if (pcall (checkArg, 1, bank, 'SmipsBank')) then
       bank:emit32 (-1)
     end
@@ -45,27 +40,329 @@ do
     local files = {...}
     local split = opt:getopt ('s')
     local output = opt:getopt ('o')
-    local unit = units.new ()
+    local jobs = opt:getopt ('j')
+    local watch = opt:getopt ('w')
+    local cache = opt:getopt ('cache')
+    local compile = opt:getopt ('c')
+    local link = opt:getopt ('link')
+    local streaming = opt:getopt ('stream')
+    local format = opt:getopt ('format')
+    local uncached = false
+
+    local function prefetch (list)
+      if (jobs > 1) then
+        return lexers.prefetch (jobs, list)
+      else
+        return {}
+      end
+    end
+
+    local function open ()
+      if (not split) then
+        return banks.new (output or '-', format)
+      elseif (output ~= nil) then
+        return splitters.new (output, split, format)
+      else
+        return splitters.new (utils.pwd (), split, format)
+      end
+    end
+
+    -- Named tags by address, only formats with
+    -- a symbol table care about them
+    local function labels (bank, symbols, address)
+      if (format == 'elf') then
+        local list = {}
+
+        for key, value in symbols:each () do
+          if (type (key) == 'string') then
+            list [key] = address (value)
+          end
+        end
+
+        bank:symbols (list)
+      end
+    end
+
+    -- Runs 'fill' over a freshly opened bank, which is discarded
+    -- if anything fails so the previous output stays in place
+    local function emit (fill)
+      local bank = open ()
+      local ok, reason = pcall (fill, bank)
+
+      if (not ok) then
+        bank:discard ()
+        error (reason, 0)
+      end
+    end
+
+    local function write (unit)
+      process (unit)
+      emit (function (bank)
+        bank:emitblock (unit.block)
+        labels (bank, unit.symbols, function (value) return unit.block:endof (value) end)
+        finish (bank)
+      end)
+    end
+
+    -- Feeds every file in 'list' into its own unit, reusing
+    -- cached units and storing fresh ones when a cache is set
+    local function feedparts (list)
+      local parts = {}
+      local misses = {}
+      local names = {}
+
+      for i, file in ipairs (list) do
+        local key, data
+
+        if (cache ~= nil and file ~= '-') then
+          key = caches.key (file)
+          data = caches.load (cache, key)
+        end
+
+        if (data ~= nil) then
+          parts [i] = units.undump (data)
+        end
+
+        if (parts [i] == nil) then
+          misses [#misses + 1] = { index = i, key = key, }
+          names [#names + 1] = file
+        end
+      end
+
+      local prefetched = prefetch (names)
+
+      for j, miss in ipairs (misses) do
+        local part = units.new ()
+        feed (part, list [miss.index], prefetched [j])
+        parts [miss.index] = part
+
+        -- units with operands no fixup can express are not
+        -- cached, a broken cache only costs time so say it once
+        if (miss.key ~= nil) then
+          local data = part:dump ()
+          local ok, reason = data ~= nil, nil
+
+          if (ok) then
+            ok, reason = caches.store (cache, miss.key, data)
+          end
+
+          if (not ok and reason ~= nil and not uncached) then
+            io.stderr:write (('Warning: units will not be cached: %s\n'):format (reason))
+            uncached = true
+          end
+        end
+      end
+    return parts
+    end
+
+    local function readobject (file)
+      local stream, reason, data, part
 
-    for _, file in ipairs (files) do
       if (file == '-') then
-        feed (unit, '(stdin)')
+        stream = io.stdin
       else
-        io.input (assert (io.open (file, 'r')))
-        feed (unit, file)
+        stream, reason = io.open (file, 'rb')
       end
+
+      if (not stream) then
+        log.error (reason)
+      else
+        data = stream:read ('*a')
+        part = units.undump (data or '')
+
+        if (stream ~= io.stdin) then
+          stream:close ()
+        end
+
+        if (part == nil) then
+          log.error (('%s: Not a relocatable object'):format (file))
+        end
+      end
+    return part
     end
 
-    process (unit)
+    local function writeobject (file, data)
+      local stream, reason
 
-    if (not split) then
-      printout (unit, banks.new (output or '-'))
-    else
-      if (output ~= nil) then
-        printout (unit, splitters.new (output, split))
+      if (file == '-') then
+        stream = io.stdout
+      else
+        stream, reason = io.open (file, 'wb')
+      end
+
+      if (not stream) then
+        log.error (reason)
+      else
+        stream:write (data)
+
+        if (stream ~= io.stdout) then
+          stream:close ()
+        end
+      end
+    end
+
+    if (streaming and (compile or link or watch)) then
+      log.error ('Can not use --stream with -c, --link or --watch')
+    end
+
+    -- ELF banks need whole words and a symbol table
+    -- each, neither of which survives striping
+    if (split and format == 'elf') then
+      log.error ('Can not use --format=elf with --split')
+    end
+
+    if (compile) then
+      if (output ~= nil and #files > 1) then
+        log.error ('Can not specify -o with -c and multiple files')
+      end
+
+      for i, part in ipairs (feedparts (files)) do
+        local file = files [i]
+        local data, reason = part:dump ()
+
+        if (data == nil) then
+          log.error (reason)
+        elseif (output ~= nil) then
+          writeobject (output, data)
+        elseif (file == '-') then
+          writeobject ('-', data)
+        else
+          writeobject (file:gsub ('%.[^%./]*$', '') .. '.o', data)
+        end
+      end
+    elseif (link) then
+      local unit = units.new ()
+
+      for _, file in ipairs (files) do
+        unit:concat (readobject (file))
+      end
+
+      write (unit)
+    elseif (streaming) then
+      local st = streams.new ()
+      local spill
+
+      -- standard input can only be read once, so it is spilled
+      -- into a temporary file which both passes map like any
+      -- other source instead of keeping it in memory
+      local function lexer (i)
+        if (files [i] == '-') then
+          if (spill == nil) then
+            local stream, reason
+
+            spill = os.tmpname ()
+            stream, reason = io.open (spill, 'wb')
+
+            if (not stream) then
+              log.error (reason)
+            end
+
+            repeat
+              local chunk = io.stdin:read (65536)
+              if (chunk ~= nil) then
+                stream:write (chunk)
+              end
+            until (chunk == nil)
+
+            stream:close ()
+          end
+          return lexers.open (spill, '(stdin)')
+        end
+      end
+
+      local function assemble ()
+        for i, file in ipairs (files) do
+          feed (st, file, lexer (i))
+        end
+
+        emit (function (bank)
+          st:rewind (bank)
+
+          for i, file in ipairs (files) do
+            feed (st, file, lexer (i))
+          end
+
+          st:flush ()
+          labels (bank, st.labels, function (value) return value end)
+          finish (bank)
+        end)
+      end
+
+      local ok, reason = pcall (assemble)
+
+      if (spill ~= nil) then
+        os.remove (spill)
+      end
+
+      if (not ok) then
+        error (reason, 0)
+      end
+    elseif (not watch) then
+      local unit = units.new ()
+
+      if (cache == nil) then
+        local prefetched = prefetch (files)
+
+        for i, file in ipairs (files) do
+          feed (unit, file, prefetched [i])
+        end
       else
-        printout (unit, splitters.new (utils.pwd (), split))
+        for _, part in ipairs (feedparts (files)) do
+          unit:concat (part)
+        end
+      end
+
+      write (unit)
+    else
+      local watcher = watchers.new (files)
+      local parts = {}
+      local pending = {}
+
+      -- Only files in 'pending' are fed again, they stay
+      -- there until all of them feed without errors
+      local function reassemble ()
+        local changed = {}
+        local names = {}
+
+        for index in pairs (pending) do
+          changed [#changed + 1] = index
+        end
+
+        table.sort (changed)
+
+        for i, index in ipairs (changed) do
+          names [i] = files [index]
+        end
+
+        for i, part in ipairs (feedparts (names)) do
+          parts [changed [i]] = part
+          pending [changed [i]] = nil
+        end
+
+        local unit = units.new ()
+
+        for index = 1, #files do
+          unit:concat (parts [index])
+        end
+
+        write (unit)
+      end
+
+      for index = 1, #files do
+        pending [index] = true
       end
+
+      repeat
+        local ok, reason = xpcall (reassemble, log.handler)
+
+        if (not ok) then
+          io.stderr:write (reason, '\n')
+        end
+
+        for _, index in ipairs (watcher:wait ()) do
+          pending [index] = true
+        end
+      until (false)
     end
   end
 return main (opt:parse (...))
@@ -39,7 +39,7 @@ do
   return banks_ [next_]
   end
 
-  function splitters.new (dir, names_)
+  function splitters.new (dir, names_, format)
     checkArg (1, dir, 'string')
     checkArg (2, names_, 'string')
     local banks_ = vector.new ()
@@ -52,29 +52,50 @@ do
         names [#names + 1] = name
       end
 
+      -- banks opened so far are dropped if a later one fails
       for _, name in ipairs (names) do
         local path = utils.build_path (dir, name)
-        local bank = banks.new (path)
+        local ok, bank = pcall (banks.new, path, format)
+
+        if (not ok) then
+          for _, opened in banks_:each () do
+            opened:discard ()
+          end
+          error (bank, 0)
+        end
+
         banks_:append (bank)
       end
     end
   return setmetatable (st, mt)
   end
 
+  -- Every bank takes its share of the gap in a single call
   function splitters.zero (self, size)
     checkArg (0, self, 'SmipsSplitter')
     checkArg (1, size, 'number')
+    local banks_ = self.banks
+    local count = banks_:length ()
     local words = (size - (size % 4)) / 4
     local left = size % 4
 
     if (left > 0) then
       error ('Unaligned write')
     else
-      for i = 1, words do
-        local _start = 1 + (i - 1) * 4
-        local _end = _start + 3;
-        (getnext (self)):emit32 (0)
+      local share = (words - (words % count)) / count
+      local extra = words % count
+
+      for i = 0, count - 1 do
+        local index = ((self.next - 1 + i) % count) + 1
+        local bank = banks_ [index]
+        local bankwords = share + (i < extra and 1 or 0)
+
+        if (bankwords > 0) then
+          bank:zero (bankwords * 4)
+        end
       end
+
+      self.next = ((self.next - 1 + extra) % count) + 1
     end
   end
 
@@ -103,9 +124,37 @@ do
     end
   end
 
+  -- The whole block is dealt over the banks natively,
+  -- carrying on from the bank the last word went to
+  function splitters.emitblock (self, block)
+    checkArg (0, self, 'SmipsSplitter')
+    checkArg (1, block, 'SmipsBlock')
+    local list = {}
+
+    for i, bank in self.banks:each () do
+      list [i] = bank
+    end
+
+    self.next = banks.stripe (block, list, self.next)
+  end
+
+  -- Words of a split image do not sit at their own address
+  -- in any single bank, so no bank gets a symbol table
+  function splitters.symbols (self, list)
+    checkArg (0, self, 'SmipsSplitter')
+    checkArg (1, list, 'table')
+  end
+
+  function splitters.discard (self)
+    checkArg (0, self, 'SmipsSplitter')
+    for _, bank in self.banks:each () do
+      bank:discard ()
+    end
+  end
+
   function splitters.close (self)
     checkArg (0, self, 'SmipsSplitter')
-    for _, bank in ipairs (self.banks) do
+    for _, bank in self.banks:each () do
       bank:close ()
     end
   end
@@ -0,0 +1,333 @@
+--[[
+-- Copyright 2021-2025 MarcosHCK
+--  This file is part of SMIPS Assembler.
+--
+--  SMIPS Assembler is free software: you can redistribute it and/or modify
+--  it under the terms of the GNU General Public License as published by
+--  the Free Software Foundation, either version 3 of the License, or
+--  (at your option) any later version.
+--
+--  SMIPS Assembler is distributed in the hope that it will be useful,
+--  but WITHOUT ANY WARRANTY; without even the implied warranty of
+--  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+--  GNU General Public License for more details.
+--
+--  You should have received a copy of the GNU General Public License
+--  along with SMIPS Assembler.  If not, see <http://www.gnu.org/licenses/>.
+]]
+local exprs = require ('exprs')
+local isa = require ('isa')
+local log = require ('log')
+local symbols = require ('symbols')
+local units = require ('unit')
+local vector = require ('vector')
+local stream = {}
+
+--
+-- A stream stands in for a unit while feeding sources twice:
+-- the first pass only sizes entries and records where tags
+-- land (as byte offsets), the second one feeds the very same
+-- sources again and emits every entry as soon as it is
+-- complete, so only the symbol table outlives a statement
+--
+
+do
+  local mt =
+  {
+    __index = stream,
+    __name = 'SmipsStream',
+  }
+
+  local localpattern = '%f[%w_]([0-9]+)([bf])%f[^%w_]'
+  local masks = { i = 0x10000, j = 0x4000000, }
+
+  local function padded (size)
+    local mis = size % 4
+  return mis > 0 and size + (4 - mis) or size
+  end
+
+  local function pad (data)
+  return data .. (string.char (0)):rep (padded (#data) - #data)
+  end
+
+  function stream.new ()
+    local st =
+    {
+      labels = symbols.new (),
+      locals = { },
+      offset = 0,
+      seqs = 0,
+    }
+
+    st.symbols = st.labels
+  return setmetatable (st, mt)
+  end
+
+  local function compe (self, ...)
+
+    local function collect (...)
+      if (select ('#', ...) > 1) then
+        return string.format (...)
+      else
+        return (...)
+      end
+    end
+
+    local ent = self.pending
+    local literal = collect (...)
+    local where = ('%s: %i'):format (ent.source or '?', ent.line or -1)
+    log.error (collect ('%s: %s', where, literal))
+  end
+
+  -- Compiled expressions are only kept around for the
+  -- source file being fed, so the cache never outgrows it
+  local function evaluate (self, expr)
+    local source = self.pending.source
+    local chunk
+
+    if (self.cachefor ~= source) then
+      self.cache = {}
+      self.cachefor = source
+    end
+
+    chunk = self.cache [expr]
+
+    if (chunk == nil) then
+      local code = expr:gsub (localpattern, '__local (%1, \'%2\')')
+      local value = exprs.eval (code)
+
+      if (value ~= nil) then
+        chunk = function () return value end
+      else
+        local reason
+        code = ('do return %s; end'):format (code)
+        chunk, reason = load (code, '=expression', 't', self.env)
+
+        if (not chunk) then
+          compe (self, reason)
+        end
+      end
+
+      self.cache [expr] = chunk
+    end
+
+    self.tagged = false
+    self.env._ = self.pending.offset
+  return chunk (), self.tagged
+  end
+
+  local function newenv (self)
+    local env = { tonumber = tonumber, tostring = tostring, }
+    local labels = self.labels
+    local findlocal = units.resolver (self.locals)
+
+    env.math = setmetatable ({}, { __mode = 'protected', __index = _G.math, })
+    env.string = setmetatable ({}, { __mode = 'protected', __index = _G.string, })
+
+    function env.__local (alias, direction)
+      local loc = findlocal (alias, direction, self.pending.seq)
+
+      if (not loc) then
+        compe (self, 'Undefined local tag \'%i%s\'', alias, direction)
+      else
+        self.tagged = true
+        return labels:lookup (loc.id)
+      end
+    end
+
+    local mt =
+    {
+      __index = function (_, key)
+        local value = labels:lookup (key)
+
+        if (value ~= nil) then
+          self.tagged = true
+          return value
+        else
+          compe (self, 'Undefined tag \'%s\'', key)
+        end
+      end,
+    }
+  return setmetatable (env, mt)
+  end
+
+  local function constant (self, ent)
+    local cs, style = ent.cs, ent.style
+    local value, tagged
+
+    if (type (cs) == 'number') then
+      value, tagged = self.labels:lookup (cs), true
+    else
+      value, tagged = evaluate (self, cs)
+    end
+
+    if (type (value) == 'number') then
+      if (tagged) then
+        if (style == 'r') then
+          value = ((value - ent.offset) / 4) - 1
+        elseif (style == 'j') then
+          value = value / 4
+        elseif (style ~= 'a') then
+          compe (self, 'Non tagable instruction')
+        end
+      elseif (style == 'r') then
+        value = ((value - ent.offset) / 4) - 1
+      end
+    elseif (type (value) == 'string') then
+      if (#value < 5) then
+        value = value:byte (1, #value)
+      else
+        compe (self, 'Data too big to fit into a register')
+      end
+    else
+      compe (self, 'Value should be constant number')
+    end
+  return value % masks [ent.kind]
+  end
+
+  local function emit (self, ent)
+    local bank = self.bank
+    local kind = ent.kind
+
+    if (kind == 'data') then
+      bank:emits (pad (ent.data))
+    elseif (kind == 'zero') then
+      bank:zero (ent.size)
+    elseif (kind == 'org') then
+      if (ent.address < ent.offset) then
+        compe (self, 'Can not move location backwards to 0x%x', ent.address)
+      else
+        bank:zero (ent.address - ent.offset)
+      end
+    elseif (kind == 'delay') then
+      local trans = isa.transforms [ent.transform]
+      local val = evaluate (self, ent.expr)
+        assert (trans)
+      bank:emits (pad (trans (val, function (...) compe (self, ...) end)))
+    elseif (ent.cs == nil) then
+      bank:emit32 (ent.word)
+    else
+      bank:emit32 (ent.word + constant (self, ent))
+    end
+  end
+
+  function stream.flush (self)
+    checkArg (0, self, 'SmipsStream')
+    local ent = self.pending
+
+    if (ent ~= nil) then
+      emit (self, ent)
+      self.pending = nil
+    end
+  end
+
+  local function advance (self, size, ent)
+    stream.flush (self)
+
+    if (self.bank ~= nil) then
+      ent.offset = self.offset
+      self.pending = ent
+    end
+
+    self.offset = self.offset + size
+  end
+
+  -- Switches to the second pass, entries go to 'bank' from now on
+  function stream.rewind (self, bank)
+    checkArg (0, self, 'SmipsStream')
+    self.bank = bank
+    self.env = newenv (self)
+    self.offset = 0
+    self.seqs = 0
+    self.symbols = symbols.new ()
+  end
+
+  function stream.annotate (self, source, line)
+    checkArg (0, self, 'SmipsStream')
+    local ent = self.pending
+
+    if (ent ~= nil) then
+      ent.source = source
+      ent.line = line
+    end
+  end
+
+  function stream.sequence (self, seq)
+    checkArg (0, self, 'SmipsStream')
+    local ent = self.pending
+
+    if (ent ~= nil) then
+      ent.seq = seq
+    end
+  end
+
+  function stream.add_data (self, data, expr, transform)
+    checkArg (0, self, 'SmipsStream')
+    checkArg (1, data, 'string', 'number')
+
+    if (type (data) == 'string') then
+      advance (self, padded (#data), { kind = 'data', data = data, })
+    elseif (expr == nil) then
+      advance (self, padded (data), { kind = 'zero', size = padded (data), })
+    else
+      advance (self, padded (data), { kind = 'delay', expr = expr, transform = transform, })
+    end
+  end
+
+  -- A backwards '.org' is only diagnosed on the second pass,
+  -- once the entry is located
+  function stream.add_org (self, address)
+    checkArg (0, self, 'SmipsStream')
+    checkArg (1, address, 'number')
+    advance (self, math.max (address - self.offset, 0), { kind = 'org', address = address, })
+  end
+
+  function stream.add_inst (self, kind, word, cs, style)
+    checkArg (0, self, 'SmipsStream')
+    advance (self, 4, { kind = kind, word = word, cs = cs, style = style, })
+  end
+
+  function stream.add_tag (self, tagname, source, line)
+    checkArg (0, self, 'SmipsStream')
+    checkArg (1, tagname, 'string')
+
+    if (not self.symbols:define (tagname, self.offset)) then
+      error (('Redefined tag %s'):format (tagname))
+    end
+  end
+
+  function stream.new_anon (self)
+    checkArg (0, self, 'SmipsStream')
+  return self.symbols:anon ()
+  end
+
+  function stream.add_anon (self, id)
+    checkArg (0, self, 'SmipsStream')
+    checkArg (1, id, 'number')
+
+    if (not self.symbols:define (id, self.offset)) then
+      error (('Redefined anonymous tag %i'):format (id))
+    end
+  end
+
+  -- The second pass hands out the same anonymous IDs,
+  -- locals are only recorded on the first one
+  function stream.add_local (self, alias, seq)
+    checkArg (0, self, 'SmipsStream')
+    local id = self:new_anon ()
+
+    if (self.bank == nil) then
+      local locals = self.locals [alias]
+
+      if (not locals) then
+        locals = vector.new ()
+        self.locals [alias] = locals
+      end
+
+      locals:append ({ id = id, seq = seq, })
+    end
+
+    self:add_anon (id)
+  end
+return stream
+end
@@ -0,0 +1,301 @@
+/* Copyright 2021-2025 MarcosHCK
+ * This file is part of SMIPS Assembler.
+ *
+ * SMIPS Assembler is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SMIPS Assembler is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with SMIPS Assembler. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <config.h>
+#include <gmodule.h>
+#include <lua.h>
+#include <lauxlib.h>
+#include <luacmpt.h>
+
+typedef struct _SmipsSymbol SmipsSymbol;
+typedef struct _SmipsSymbols SmipsSymbols;
+#define META "SmipsSymbols"
+#define UNDEFINED G_MAXUINT
+
+/*
+ * Named symbols are interned into a string chunk and kept in
+ * definition order, 'slots' is an open-addressing (linear
+ * probing) index into them. Anonymous symbols (jal return
+ * points, numeric local labels) are plain integer IDs
+ *
+ */
+
+struct _SmipsSymbol
+{
+  const gchar* name;
+  gsize length;
+  guint hash;
+  guint value;
+};
+
+struct _SmipsSymbols
+{
+  GStringChunk* names;
+  GArray* named;
+  GArray* anons;
+  guint* slots;
+  guint mask;
+};
+
+static guint hash (const gchar* name, gsize length)
+{
+  guint32 value = 2166136261u;
+  gsize i;
+
+  for (i = 0; i < length; i++)
+    value = (value ^ (guint8) name [i]) * 16777619u;
+return value;
+}
+
+static guint* probe (SmipsSymbols* self, const gchar* name, gsize length, guint hashed)
+{
+  const SmipsSymbol* symbol = NULL;
+  guint at = hashed & self->mask;
+
+  while (self->slots [at] != 0)
+  {
+    symbol = & g_array_index (self->named, SmipsSymbol, self->slots [at] - 1);
+
+    if (symbol->hash == hashed
+      && symbol->length == length
+      && memcmp (symbol->name, name, length) == 0)
+      break;
+
+    at = (at + 1) & self->mask;
+  }
+return & self->slots [at];
+}
+
+static void grow (SmipsSymbols* self)
+{
+  const SmipsSymbol* symbol = NULL;
+  guint i, size = (self->mask + 1) << 1;
+
+  g_free (self->slots);
+  self->slots = g_new0 (guint, size);
+  self->mask = size - 1;
+
+  for (i = 0; i < self->named->len; i++)
+  {
+    symbol = & g_array_index (self->named, SmipsSymbol, i);
+    *probe (self, symbol->name, symbol->length, symbol->hash) = i + 1;
+  }
+}
+
+static guint* anonslot (lua_State* L, SmipsSymbols* self, int idx)
+{
+  const lua_Integer id = lua_tointeger (L, idx);
+
+  if (id < 1 || id > self->anons->len)
+    luaL_argerror (L, idx, "unknown anonymous symbol");
+return & g_array_index (self->anons, guint, id - 1);
+}
+
+/*
+ * Lua API
+ *
+ */
+
+static int __gc (lua_State* L)
+{
+  SmipsSymbols* self = luaL_checkudata (L, 1, META);
+  g_clear_pointer (&self->names, g_string_chunk_free);
+  g_clear_pointer (&self->named, g_array_unref);
+  g_clear_pointer (&self->anons, g_array_unref);
+  g_clear_pointer (&self->slots, g_free);
+return 0;
+}
+
+static int _new (lua_State* L)
+{
+  const gsize sz = sizeof (SmipsSymbols);
+  SmipsSymbols* self = lua_newuserdata (L, sz);
+
+  memset (self, 0, sz);
+#if LUA_VERSION_NUM >= 502
+  luaL_setmetatable (L, META);
+#else // LUA_VERSION_NUM < 502
+  lua_getfield (L, LUA_REGISTRYINDEX, META);
+  lua_setmetatable (L, -2);
+#endif // LUA_VERSION_NUM
+
+  self->names = g_string_chunk_new (4096);
+  self->named = g_array_new (FALSE, FALSE, sizeof (SmipsSymbol));
+  self->anons = g_array_new (FALSE, FALSE, sizeof (guint));
+  self->slots = g_new0 (guint, 64);
+  self->mask = 64 - 1;
+return 1;
+}
+
+static int define (lua_State* L)
+{
+  SmipsSymbols* self = luaL_checkudata (L, 1, META);
+  const guint value = (guint) luaL_checkinteger (L, 3);
+  SmipsSymbol symbol = {0};
+  guint* slot = NULL;
+
+  if (lua_type (L, 2) == LUA_TNUMBER)
+  {
+    if (*(slot = anonslot (L, self, 2)) != UNDEFINED)
+      return (lua_pushboolean (L, FALSE), 1);
+
+    *slot = value;
+  }
+  else
+  {
+    symbol.name = luaL_checklstring (L, 2, &symbol.length);
+    symbol.hash = hash (symbol.name, symbol.length);
+
+    if (*(slot = probe (self, symbol.name, symbol.length, symbol.hash)) != 0)
+      return (lua_pushboolean (L, FALSE), 1);
+
+    symbol.name = g_string_chunk_insert_len (self->names, symbol.name, symbol.length);
+    symbol.value = value;
+
+    g_array_append_val (self->named, symbol);
+    *slot = self->named->len;
+
+    if (self->named->len * 2 > self->mask)
+      grow (self);
+  }
+return (lua_pushboolean (L, TRUE), 1);
+}
+
+static int lookup (lua_State* L)
+{
+  SmipsSymbols* self = luaL_checkudata (L, 1, META);
+  const SmipsSymbol* symbol = NULL;
+  const gchar* name = NULL;
+  gsize length = 0;
+  guint slot;
+
+  if (lua_type (L, 2) == LUA_TNUMBER)
+  {
+    if ((slot = *anonslot (L, self, 2)) == UNDEFINED)
+      lua_pushnil (L);
+    else
+      lua_pushinteger (L, slot);
+  }
+  else
+  {
+    name = luaL_checklstring (L, 2, &length);
+
+    if ((slot = *probe (self, name, length, hash (name, length))) == 0)
+      lua_pushnil (L);
+    else
+    {
+      symbol = & g_array_index (self->named, SmipsSymbol, slot - 1);
+      lua_pushinteger (L, symbol->value);
+    }
+  }
+return 1;
+}
+
+static int anon (lua_State* L)
+{
+  SmipsSymbols* self = luaL_checkudata (L, 1, META);
+  const lua_Integer count = luaL_optinteger (L, 2, 1);
+  const guint first = self->anons->len + 1;
+  guint i;
+
+  luaL_argcheck (L, count >= 0, 2, "expected a non-negative count");
+
+  for (i = 0; i < count; i++)
+  {
+    const guint undefined = UNDEFINED;
+    g_array_append_val (self->anons, undefined);
+  }
+return (lua_pushinteger (L, first), 1);
+}
+
+static int anons (lua_State* L)
+{
+  SmipsSymbols* self = luaL_checkudata (L, 1, META);
+return (lua_pushinteger (L, self->anons->len), 1);
+}
+
+static int eachnext (lua_State* L)
+{
+  SmipsSymbols* self = luaL_checkudata (L, lua_upvalueindex (1), META);
+  guint at = (guint) lua_tointeger (L, lua_upvalueindex (2));
+  const SmipsSymbol* symbol = NULL;
+  guint value;
+
+  for (; at < self->named->len + self->anons->len; at++)
+  {
+    if (at < self->named->len)
+    {
+      symbol = & g_array_index (self->named, SmipsSymbol, at);
+      lua_pushlstring (L, symbol->name, symbol->length);
+      lua_pushinteger (L, symbol->value);
+    }
+    else
+    {
+      value = g_array_index (self->anons, guint, at - self->named->len);
+
+      if (value == UNDEFINED)
+        continue;
+
+      lua_pushinteger (L, at - self->named->len + 1);
+      lua_pushinteger (L, value);
+    }
+
+    lua_pushinteger (L, at + 1);
+    lua_replace (L, lua_upvalueindex (2));
+    return 2;
+  }
+return 0;
+}
+
+static int each (lua_State* L)
+{
+  luaL_checkudata (L, 1, META);
+  lua_settop (L, 1);
+  lua_pushinteger (L, 0);
+  lua_pushcclosure (L, eachnext, 2);
+return 1;
+}
+
+G_MODULE_EXPORT
+int luaopen_symbols (lua_State* L)
+{
+  lua_createtable (L, 0, 6);
+  luaL_newmetatable (L, META);
+#if LUA_VERSION_NUM < 503
+  lua_pushliteral (L, META);
+  lua_setfield (L, -2, "__name");
+#endif // LUA_VERSION_NUM
+  lua_pushcfunction (L, __gc);
+  lua_setfield (L, -2, "__gc");
+  lua_pushvalue (L, -2);
+  lua_setfield (L, -2, "__index");
+  lua_pop (L, 1);
+
+  lua_pushcfunction (L, _new);
+  lua_setfield (L, -2, "new");
+  lua_pushcfunction (L, define);
+  lua_setfield (L, -2, "define");
+  lua_pushcfunction (L, lookup);
+  lua_setfield (L, -2, "lookup");
+  lua_pushcfunction (L, anon);
+  lua_setfield (L, -2, "anon");
+  lua_pushcfunction (L, anons);
+  lua_setfield (L, -2, "anons");
+  lua_pushcfunction (L, each);
+  lua_setfield (L, -2, "each");
+return 1;
+}
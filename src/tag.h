@@ -33,9 +33,10 @@ struct _SmipsTagIndex
   goffset offset;
 };
 
-G_GNUC_INTERNAL void *_smips_tag_new ();
-G_GNUC_INTERNAL void *_smips_tag_ref (gpointer ptag);
-G_GNUC_INTERNAL void _smips_tag_unref (gpointer ptag);
+G_GNUC_INTERNAL void _smips_tag_arena_init (SmipsTagArena* arena);
+G_GNUC_INTERNAL void _smips_tag_arena_clear (SmipsTagArena* arena);
+G_GNUC_INTERNAL SmipsTag* _smips_tag_new (SmipsTagArena* arena);
+G_GNUC_INTERNAL SmipsTag* _smips_tag_cons (SmipsTagArena* arena, const SmipsTag* proto);
 G_GNUC_INTERNAL void _smips_tag_type (const SmipsTag* tag, const gchar** _type, const gchar** _subtype);
 G_GNUC_INTERNAL void _smips_tag_print (const SmipsTag* tag, int level);
 G_GNUC_INTERNAL const SmipsTagIndex* _smips_tag_index_lookup (const char *str, size_t len);
@@ -16,86 +16,234 @@
  *
  */
 #include <config.h>
+#include <blocks.h>
 #include <gmodule.h>
+#include <math.h>
 #include <tag.h>
 #include <tags.h>
 
-static SmipsTag* _new (lua_State* L);
-static int _wrap (lua_State* L, SmipsTag* tag);
-static int _abs (lua_State* L);
-static int _rel (lua_State* L);
+typedef struct _SmipsTagRef SmipsTagRef;
 
 #define META "SmipsTag"
-#define checktag(L,idx) \
-  (G_GNUC_EXTENSION ({ \
-      lua_State* __L = ((L)); \
-      int __idx = ((idx)); \
-      void* __ud = NULL; \
-      __ud = luaL_checkudata (__L, __idx, META); \
-      *(SmipsTag**) __ud; \
-    }))
-
-#define operation(name,_type) \
-  static int name (lua_State* L) \
-  { \
-    SmipsTag* tag1 = NULL; \
-    SmipsTag* tag2 = NULL; \
-    SmipsTag* self = NULL; \
-    guint invert = 0; \
-; \
-    lua_settop (L, 2); \
-; \
-    if (luaL_testudata (L, 2, META)) \
-    { \
-      lua_insert (L, 1); \
-      invert = 1; \
-    } \
-    if (!luaL_testudata (L, 2, META)) \
-    { \
-      lua_pushcfunction (L, _abs); \
-      lua_insert (L, 2); \
-      lua_call (L, 1, 1); \
-    } \
-; \
-    tag1 = checktag (L, 1 + invert); \
-    tag2 = checktag (L, 2 - invert); \
-; \
-    self = _new (L); \
-    self->type = TAG_OPER | (_type); \
-    self->left = _smips_tag_ref (tag1); \
-    self->right = _smips_tag_ref (tag2); \
-  return 1; \
-  }
-
-  static int __unm (lua_State* L)
-  {
-    SmipsTag* tag1 = NULL;
-    SmipsTag* self = NULL;
-
-    tag1 = checktag (L, 1);
-
-    self = _new (L);
-    self->type = TAG_UNM;
-    self->left = _smips_tag_ref (tag1);
-    self->right = NULL;
-  return 1;
-  }
-
-operation (__add, TAG_ADD)
-operation (__sub, TAG_SUB)
-operation (__mul, TAG_MUL)
-operation (__div, TAG_DIV)
-operation (__idiv, TAG_IDIV)
-operation (__mod, TAG_MOD)
-#undef operation
-
-static int __gc (lua_State* L)
+#define ARENA "SmipsTagArena"
+
+#if LUA_VERSION_NUM >= 502
+# define getuservalue(L,idx) lua_getuservalue ((L), (idx))
+# define setuservalue(L,idx) lua_setuservalue ((L), (idx))
+#else // LUA_VERSION_NUM < 502
+# define getuservalue(L,idx) lua_getfenv ((L), (idx))
+# define setuservalue(L,idx) lua_setfenv ((L), (idx))
+#endif // LUA_VERSION_NUM
+
+/*
+ * Tag userdatas only reference a node living in an arena;
+ * each arena keeps a weak table of the wrappers it handed
+ * out, so reading 'left' or 'right' twice yields the same
+ * userdata. That table is every wrapper's user value and
+ * its metatable holds the arena, so no wrapper outlives
+ * the arena it points into
+ *
+ */
+
+struct _SmipsTagRef
 {
-  SmipsTag* self = checktag (L, 1);
-  _smips_tag_unref (self);
-return 0;
+  SmipsTag* tag;
+  SmipsTagArena* arena;
+};
+
+#define checktag(L,idx) (checkref ((L), (idx))->tag)
+
+static SmipsTagRef* checkref (lua_State* L, int idx)
+{
+  SmipsTagRef* ref = luaL_checkudata (L, idx, META);
+
+  if (G_UNLIKELY (ref->arena->released))
+    luaL_error (L, "attempt to use a tag from a released arena");
+return ref;
 }
 
+static SmipsTagArena* checkarena (lua_State* L, int idx)
+{
+  SmipsTagArena* arena = luaL_checkudata (L, idx, ARENA);
+
+  if (G_UNLIKELY (arena->released))
+    luaL_error (L, "attempt to use a released arena");
+return arena;
+}
+
+static int _wrap (lua_State* L, int cache, SmipsTagArena* arena, SmipsTag* tag)
+{
+  SmipsTagRef* ref = NULL;
+
+  lua_pushlightuserdata (L, tag);
+  lua_rawget (L, cache);
+
+  if (!lua_isnil (L, -1))
+    return 1;
+
+  lua_pop (L, 1);
+  ref = lua_newuserdata (L, sizeof (SmipsTagRef));
+#if LUA_VERSION_NUM >= 502
+  luaL_setmetatable (L, META);
+#else // LUA_VERSION_NUM
+  lua_getfield (L, LUA_REGISTRYINDEX, META);
+  lua_setmetatable (L, -2);
+#endif // LUA_VERSION_NUM
+  ref->tag = tag;
+  ref->arena = arena;
+
+  lua_pushvalue (L, cache);
+  setuservalue (L, -2);
+  lua_pushlightuserdata (L, tag);
+  lua_pushvalue (L, -2);
+  lua_rawset (L, cache);
+return 1;
+}
+
+static int push (lua_State* L, int owner, SmipsTagArena* arena, SmipsTag* tag)
+{
+  getuservalue (L, owner);
+  _wrap (L, lua_gettop (L), arena, tag);
+  lua_remove (L, -2);
+return 1;
+}
+
+static SmipsTag* operand (lua_State* L, SmipsTagArena* arena, int idx)
+{
+  SmipsTagRef* ref = NULL;
+  SmipsTag* tag = NULL;
+
+  if (!luaL_testudata (L, idx, META))
+  {
+    SmipsTag proto = { TAG_VALUE | TAG_ABSOLUTE, };
+    proto.value = (guint) luaL_checkinteger (L, idx);
+    tag = _smips_tag_cons (arena, &proto);
+  }
+  else
+  {
+    ref = checkref (L, idx);
+    tag = ref->tag;
+
+    if (G_UNLIKELY (ref->arena != arena))
+      luaL_error (L, "attempt to mix tags from different arenas");
+  }
+return tag;
+}
+
+#define isabsolute(tag) ((tag)->type == (TAG_VALUE | TAG_ABSOLUTE))
+#define isconstant(tag,v) (isabsolute ((tag)) && (tag)->value == (v))
+
+/*
+ * Operations over absolute values are folded only when the
+ * result fits a value node unchanged, so folding never alters
+ * what process () would have calculated from the whole tree
+ *
+ */
+
+static gboolean fold (int type, guint left, guint right, guint* value)
+{
+  switch (type)
+  {
+    case TAG_ADD:
+      if (left > G_MAXUINT - right)
+        return FALSE;
+      *value = left + right;
+      return TRUE;
+    case TAG_SUB:
+      if (left < right)
+        return FALSE;
+      *value = left - right;
+      return TRUE;
+    case TAG_MUL:
+      if (right != 0 && left > G_MAXUINT / right)
+        return FALSE;
+      *value = left * right;
+      return TRUE;
+    case TAG_DIV:
+      if (right == 0 || left % right != 0)
+        return FALSE;
+      *value = left / right;
+      return TRUE;
+    case TAG_IDIV:
+      if (right == 0)
+        return FALSE;
+      *value = left / right;
+      return TRUE;
+    case TAG_MOD:
+      if (right == 0)
+        return FALSE;
+      *value = left % right;
+      return TRUE;
+  }
+return FALSE;
+}
+
+static int operation (lua_State* L, int type)
+{
+  SmipsTagRef* owner = NULL;
+  SmipsTag *left, *right, *self;
+  SmipsTag proto = { 0, };
+  int at;
+
+  lua_settop (L, 2);
+  at = luaL_testudata (L, 1, META) ? 1 : 2;
+  owner = checkref (L, at);
+
+  left = operand (L, owner->arena, 1);
+  right = operand (L, owner->arena, 2);
+
+  if (isabsolute (left) && isabsolute (right)
+    && fold (type, left->value, right->value, &proto.value))
+  {
+    proto.type = TAG_VALUE | TAG_ABSOLUTE;
+    self = _smips_tag_cons (owner->arena, &proto);
+  }
+  else if ((type == TAG_ADD || type == TAG_SUB) && isconstant (right, 0))
+    self = left;
+  else if (type == TAG_ADD && isconstant (left, 0))
+    self = right;
+  /* x // 1 is only x for integral x, absolute ones fold above */
+  else if ((type == TAG_MUL || type == TAG_DIV) && isconstant (right, 1))
+    self = left;
+  else if (type == TAG_MUL && isconstant (left, 1))
+    self = right;
+  else
+  {
+    proto.type = TAG_OPER | type;
+    proto.left = left;
+    proto.right = right;
+    self = _smips_tag_cons (owner->arena, &proto);
+  }
+return push (L, at, owner->arena, self);
+}
+
+static int __unm (lua_State* L)
+{
+  SmipsTagRef* owner = checkref (L, 1);
+  SmipsTag proto = { TAG_UNM, };
+
+  if (isconstant (owner->tag, 0))
+    return (lua_settop (L, 1), 1);
+
+  proto.left = owner->tag;
+  proto.right = NULL;
+return push (L, 1, owner->arena, _smips_tag_cons (owner->arena, &proto));
+}
+
+#define binary(name,_type) \
+  static int name (lua_State* L) \
+  { \
+    return operation (L, (_type)); \
+  }
+
+binary (__add, TAG_ADD)
+binary (__sub, TAG_SUB)
+binary (__mul, TAG_MUL)
+binary (__div, TAG_DIV)
+binary (__idiv, TAG_IDIV)
+binary (__mod, TAG_MOD)
+#undef binary
+
 static int __index (lua_State* L)
 {
   size_t keysz;
@@ -128,14 +276,11 @@ static int __index (lua_State* L)
 
         case -1:
           {
-            const SmipsTag* value = NULL;
+            SmipsTag* value = NULL;
             if ((value = G_STRUCT_MEMBER (SmipsTag*, self, index->offset)) == NULL)
               lua_pushnil (L);
             else
-            {
-              _smips_tag_ref ((SmipsTag*) value);
-              _wrap (L, (SmipsTag*) value);
-            }
+              push (L, 1, checkref (L, 1)->arena, value);
           }
           break;
       }
@@ -144,48 +289,354 @@ static int __index (lua_State* L)
 return 1;
 }
 
-static int _wrap (lua_State* L, SmipsTag* tag)
+static int value (lua_State* L, int type)
 {
-  const int type = 0;
-  const gsize sz = sizeof (SmipsTag*);
-  SmipsTag** ref = lua_newuserdata (L, sz);
+  SmipsTagArena* arena = checkarena (L, 1);
+  SmipsTag proto = { TAG_VALUE | type, };
+
+  proto.value = (guint) luaL_optinteger (L, 2, 0);
+return push (L, 1, arena, _smips_tag_cons (arena, &proto));
+}
+
+static int _abs (lua_State* L)
+{
+  lua_pushvalue (L, lua_upvalueindex (1));
+  lua_insert (L, 1);
+return value (L, TAG_ABSOLUTE);
+}
+
+static int _rel (lua_State* L)
+{
+  lua_pushvalue (L, lua_upvalueindex (1));
+  lua_insert (L, 1);
+return value (L, TAG_RELATIVE);
+}
+
+static int _arena_abs (lua_State* L)
+{
+return value (L, TAG_ABSOLUTE);
+}
+
+static int _arena_rel (lua_State* L)
+{
+return value (L, TAG_RELATIVE);
+}
+
+static int _arena_release (lua_State* L)
+{
+  SmipsTagArena* arena = luaL_checkudata (L, 1, ARENA);
+
+  if (!arena->released)
+    _smips_tag_arena_clear (arena);
+return 0;
+}
+
+static int _arena (lua_State* L)
+{
+  SmipsTagArena* arena = lua_newuserdata (L, sizeof (SmipsTagArena));
 #if LUA_VERSION_NUM >= 502
-  luaL_setmetatable (L, META);
+  luaL_setmetatable (L, ARENA);
 #else // LUA_VERSION_NUM
-  lua_getfield (L, LUA_REGISTRYINDEX, META);
+  lua_getfield (L, LUA_REGISTRYINDEX, ARENA);
   lua_setmetatable (L, -2);
 #endif // LUA_VERSION_NUM
-    *ref = tag;
+  _smips_tag_arena_init (arena);
+
+  lua_newtable (L);
+  lua_createtable (L, 0, 2);
+  lua_pushliteral (L, "v");
+  lua_setfield (L, -2, "__mode");
+  lua_pushvalue (L, -3);
+  lua_setfield (L, -2, "arena");
+  lua_setmetatable (L, -2);
+  setuservalue (L, -2);
 return 1;
 }
 
-static SmipsTag* _new (lua_State* L)
+/*
+ * Evaluation reads relative values off a placed block and
+ * memoizes operation nodes, so subtrees shared by several
+ * fixups are computed once; remembered results are dropped
+ * whenever the arena is evaluated against another block
+ *
+ * Evaluators never touch the Lua state, so fixups can be
+ * resolved on worker threads, each with a memo of its own
+ *
+ */
+
+#define EXACT (9007199254740992.0)
+#define FIXUP_SLICE (2048)
+
+typedef struct _Evaluator Evaluator;
+typedef struct _Fixup Fixup;
+typedef struct _FixupSlice FixupSlice;
+
+enum
 {
-  SmipsTag* self;
-  _wrap (L, (self = _smips_tag_new ()));
-return self;
+  EVAL_OK,
+  EVAL_OUTSIDE,
+  EVAL_ZERO,
+  EVAL_INEXACT,
+  EVAL_UNPATCHABLE,
+};
+
+struct _Evaluator
+{
+  const SmipsBlock* block;
+  GHashTable* memo;
+  GArray* results;
+};
+
+struct _Fixup
+{
+  lua_Integer index;
+  const SmipsTag* tag;
+};
+
+struct _FixupSlice
+{
+  SmipsBlock* block;
+  Fixup* fixups;
+  guint length;
+  guint failed;
+  int error;
+};
+
+static const gchar* errors [] =
+{
+  NULL,
+  "relative tag lies outside the block",
+  "attempt to divide by zero",
+  "number has no integer representation",
+  "instruction takes no constant",
+};
+
+static int evaluate (Evaluator* ev, const SmipsTag* tag, lua_Number* value)
+{
+  lua_Number left, right = 0;
+  gpointer slot;
+  guint endof;
+  int error;
+
+  if ((tag->type & TAG_VALUE) != 0)
+  {
+    if ((tag->type & TAG_VALUE_MASK) == TAG_ABSOLUTE)
+      *value = (lua_Number) tag->value;
+    else if (_smips_block_endof (ev->block, tag->value, &endof))
+      *value = (lua_Number) endof;
+    else
+      return EVAL_OUTSIDE;
+    return EVAL_OK;
+  }
+
+  if ((slot = g_hash_table_lookup (ev->memo, tag)) != NULL)
+  {
+    *value = g_array_index (ev->results, lua_Number, GPOINTER_TO_UINT (slot) - 1);
+    return EVAL_OK;
+  }
+
+  if ((error = evaluate (ev, tag->left, &left)) != EVAL_OK)
+    return error;
+  if (tag->right != NULL && (error = evaluate (ev, tag->right, &right)) != EVAL_OK)
+    return error;
+
+  switch (tag->type & TAG_OPER_MASK)
+  {
+    case TAG_ADD: *value = left + right; break;
+    case TAG_SUB: *value = left - right; break;
+    case TAG_MUL: *value = left * right; break;
+    case TAG_UNM: *value = -left; break;
+
+    case TAG_DIV:
+    case TAG_IDIV:
+    case TAG_MOD:
+      if (G_UNLIKELY (right == 0))
+        return EVAL_ZERO;
+      else if ((tag->type & TAG_OPER_MASK) == TAG_DIV)
+        *value = left / right;
+      else if ((tag->type & TAG_OPER_MASK) == TAG_IDIV)
+        *value = floor (left / right);
+      else
+        *value = left - floor (left / right) * right;
+      break;
+
+    default:
+      g_assert_not_reached ();
+  }
+
+  g_array_append_val (ev->results, *value);
+  g_hash_table_insert (ev->memo, (gpointer) tag, GUINT_TO_POINTER (ev->results->len));
+return EVAL_OK;
 }
 
-static int _abs (lua_State* L)
+static gboolean exact (lua_Number value)
 {
-  const int type = TAG_ABSOLUTE;
-  const guint value = luaL_optinteger (L, 1, 0);
-  SmipsTag* self = _new (L);
-    self->type = TAG_VALUE | type;
-    self->value = value;
-return 1;
+return value > -EXACT && value < EXACT && (lua_Number) (lua_Integer) value == value;
 }
 
-static int _rel (lua_State* L)
+static int _evaluate (lua_State* L)
 {
-  const int type = TAG_RELATIVE;
-  const guint value = luaL_optinteger (L, 1, 0);
-  SmipsTag* self = _new (L);
-    self->type = TAG_VALUE | type;
-    self->value = value;
+  SmipsTagRef* ref = checkref (L, 1);
+  const SmipsBlock* block = _smips_block_check (L, 2);
+  SmipsTagArena* arena = ref->arena;
+  Evaluator ev = { block, arena->memo, arena->results, };
+  lua_Number value;
+  int error;
+
+  if (arena->memofor != block)
+  {
+    g_hash_table_remove_all (arena->memo);
+    g_array_set_size (arena->results, 0);
+    arena->memofor = block;
+  }
+
+  if ((error = evaluate (&ev, ref->tag, &value)) != EVAL_OK)
+    luaL_error (L, "%s", errors [error]);
+  else if (exact (value))
+    lua_pushinteger (L, (lua_Integer) value);
+  else
+    lua_pushnumber (L, value);
 return 1;
 }
 
+static void resolve (FixupSlice* slice, gpointer user_data)
+{
+  Evaluator ev = { slice->block, };
+  lua_Number value;
+  guint i;
+
+  ev.memo = g_hash_table_new (g_direct_hash, g_direct_equal);
+  ev.results = g_array_new (FALSE, FALSE, sizeof (lua_Number));
+
+  for (i = 0; i < slice->length; i++)
+  {
+    const Fixup* fixup = & slice->fixups [i];
+
+    if ((slice->error = evaluate (&ev, fixup->tag, &value)) == EVAL_OK)
+    {
+      if (!exact (value))
+        slice->error = EVAL_INEXACT;
+      else if (!_smips_block_patch (slice->block, fixup->index, (guint) (lua_Integer) value))
+        slice->error = EVAL_UNPATCHABLE;
+    }
+
+    if (slice->error != EVAL_OK)
+    {
+      slice->failed = i;
+      break;
+    }
+  }
+
+  g_hash_table_unref (ev.memo);
+  g_array_unref (ev.results);
+}
+
+static gint compare (gconstpointer a, gconstpointer b)
+{
+  const lua_Integer left = ((const Fixup*) a)->index;
+  const lua_Integer right = ((const Fixup*) b)->index;
+return (left > right) - (left < right);
+}
+
+/*
+ * Patches every instruction in 'fixups' (entry index to tag)
+ * with the value its tag evaluates to; returns true, or nil
+ * plus a message and the index of the first failing entry
+ *
+ */
+
+static int _resolve (lua_State* L)
+{
+  SmipsBlock* block = _smips_block_check (L, 1);
+  GArray* fixups = g_array_new (FALSE, FALSE, sizeof (Fixup));
+  FixupSlice* slices = NULL;
+  FixupSlice* failed = NULL;
+  GThreadPool* pool = NULL;
+  GError* tmperr = NULL;
+  guint i, count;
+
+  luaL_checktype (L, 2, LUA_TTABLE);
+  lua_settop (L, 2);
+  lua_pushnil (L);
+
+  while (lua_next (L, 2))
+  {
+    Fixup fixup = { lua_tointeger (L, -2), };
+    SmipsTagRef* ref = NULL;
+
+    if (!luaL_testudata (L, -1, META) || lua_type (L, -2) != LUA_TNUMBER)
+    {
+      g_array_unref (fixups);
+      luaL_argerror (L, 2, "expected a table of tags by entry index");
+    }
+
+    if (G_UNLIKELY ((ref = lua_touserdata (L, -1))->arena->released))
+    {
+      g_array_unref (fixups);
+      luaL_error (L, "attempt to use a tag from a released arena");
+    }
+
+    fixup.tag = ref->tag;
+    g_array_append_val (fixups, fixup);
+    lua_pop (L, 1);
+  }
+
+  /* fixed order, so the reported failure does not depend on scheduling */
+  g_array_sort (fixups, compare);
+
+  count = MIN (g_get_num_processors (), (fixups->len + FIXUP_SLICE - 1) / FIXUP_SLICE);
+  count = MAX (count, 1);
+  slices = g_new0 (FixupSlice, count);
+
+  for (i = 0; i < count; i++)
+  {
+    const guint from = (guint) (((guint64) fixups->len * i) / count);
+    const guint to = (guint) (((guint64) fixups->len * (i + 1)) / count);
+
+    slices [i].block = block;
+    slices [i].fixups = & g_array_index (fixups, Fixup, from);
+    slices [i].length = to - from;
+  }
+
+  if (count > 1)
+    pool = g_thread_pool_new ((GFunc) resolve, NULL, count, FALSE, &tmperr);
+
+  if (pool == NULL)
+  {
+    g_clear_error (&tmperr);
+
+    for (i = 0; i < count; i++)
+      resolve (& slices [i], NULL);
+  }
+  else
+  {
+    for (i = 0; i < count; i++)
+      g_thread_pool_push (pool, & slices [i], NULL);
+
+    /* waits for every slice to be resolved */
+    g_thread_pool_free (pool, FALSE, TRUE);
+  }
+
+  for (i = 0; i < count && failed == NULL; i++)
+  {
+    if (slices [i].error != EVAL_OK)
+      failed = & slices [i];
+  }
+
+  if (failed == NULL)
+    lua_pushboolean (L, TRUE);
+  else
+  {
+    lua_pushnil (L);
+    lua_pushstring (L, errors [failed->error]);
+    lua_pushinteger (L, failed->fixups [failed->failed].index);
+  }
+
+  g_free (slices);
+  g_array_unref (fixups);
+return (failed == NULL) ? 1 : 3;
+}
+
 static int _type (lua_State* L)
 {
   const SmipsTag* self = checktag (L, 1);
@@ -213,7 +664,7 @@ return 0;
 G_MODULE_EXPORT
 int luaopen_tags (lua_State* L)
 {
-  lua_createtable (L, 0, 5);
+  lua_createtable (L, 0, 8);
   luaL_newmetatable (L, META);
 #if LUA_VERSION_NUM < 503
   lua_pushliteral (L, META);
@@ -233,22 +684,46 @@ int luaopen_tags (lua_State* L)
   lua_setfield (L, -2, "__mod");
   lua_pushcfunction (L, __unm);
   lua_setfield (L, -2, "__unm");
-  lua_pushcfunction (L, __gc);
-  lua_setfield (L, -2, "__gc");
   lua_pushvalue (L, -2);
   lua_pushcclosure (L, __index, 1);
   lua_setfield (L, -2, "__index");
   lua_pop (L, 1);
 
-  lua_pushcfunction (L, _abs);
+  luaL_newmetatable (L, ARENA);
+#if LUA_VERSION_NUM < 503
+  lua_pushliteral (L, ARENA);
+  lua_setfield (L, -2, "__name");
+#endif // LUA_VERSION_NUM
+  lua_pushcfunction (L, _arena_release);
+  lua_setfield (L, -2, "__gc");
+  lua_createtable (L, 0, 3);
+  lua_pushcfunction (L, _arena_abs);
   lua_setfield (L, -2, "abs");
-  lua_pushcfunction (L, _rel);
+  lua_pushcfunction (L, _arena_rel);
+  lua_setfield (L, -2, "rel");
+  lua_pushcfunction (L, _arena_release);
+  lua_setfield (L, -2, "release");
+  lua_setfield (L, -2, "__index");
+  lua_pop (L, 1);
+
+  /* loose tags live as long as the module does */
+  _arena (L);
+  lua_pushvalue (L, -1);
+  lua_pushcclosure (L, _abs, 1);
+  lua_setfield (L, -3, "abs");
+  lua_pushcclosure (L, _rel, 1);
   lua_setfield (L, -2, "rel");
+  lua_pushcfunction (L, _arena);
+  lua_setfield (L, -2, "arena");
   lua_pushcfunction (L, _type);
   lua_setfield (L, -2, "type");
   lua_pushcfunction (L, _subtype);
   lua_setfield (L, -2, "subtype");
   lua_pushcfunction (L, _print);
   lua_setfield (L, -2, "print");
+  lua_pushcfunction (L, _evaluate);
+  lua_setfield (L, -2, "evaluate");
+  lua_pushcfunction (L, _resolve);
+  lua_setfield (L, -2, "resolve");
 return 1;
 }
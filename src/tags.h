@@ -24,6 +24,7 @@
 
 typedef struct _SmipsTag SmipsTag;
 typedef struct _SmipsTagOp SmipsTagOp;
+typedef struct _SmipsTagArena SmipsTagArena;
 
 #if __cplusplus
 extern "C" {
@@ -51,7 +52,6 @@ enum
 
 struct _SmipsTag
 {
-  guint refs;
   int type;
 
   union
@@ -66,6 +66,30 @@ struct _SmipsTag
   };
 };
 
+/*
+ * Tag nodes are carved out of fixed-size chunks and
+ * released all at once, along with the whole arena;
+ * structurally equal nodes are shared through 'nodes'
+ *
+ * Evaluated operations are remembered in 'memo' (node to
+ * 1-based slot in 'results') for as long as the arena is
+ * evaluated against the block in 'memofor'
+ *
+ */
+
+#define SMIPS_TAG_CHUNK (512)
+
+struct _SmipsTagArena
+{
+  GPtrArray* chunks;
+  GHashTable* nodes;
+  GHashTable* memo;
+  GArray* results;
+  gconstpointer memofor;
+  guint used;
+  gboolean released;
+};
+
 #if __cplusplus
 }
 #endif // __cplusplus
@@ -15,7 +15,11 @@
 --  You should have received a copy of the GNU General Public License
 --  along with SMIPS Assembler.  If not, see <http://www.gnu.org/licenses/>.
 ]]
-local tags = require ('tags')
+local blocks = require ('blocks')
+local exprs = require ('exprs')
+local isa = require ('isa')
+local log = require ('log')
+local symbols = require ('symbols')
 local vector = require ('vector')
 local unit = {}
 
@@ -29,101 +33,666 @@ do
   function unit.new ()
     local st =
     {
-      block = vector.new (),
+      block = blocks.new (),
+      defs = { },
       locals = { },
-      tags = { },
+      seqs = 0,
+      symbols = symbols.new (),
     }
-
-      st.block:append ({ size = 0 })
   return setmetatable (st, mt)
   end
 
-  function unit.last (self)
-    checkArg (0, self, 'SmipsUnit')
-    local block = self.block
-  return block:last ()
-  end
-
   function unit.annotate (self, source, line)
     checkArg (0, self, 'SmipsUnit')
     checkArg (1, source, 'string')
     checkArg (2, line, 'number')
-    local last = self.block:last ()
-
-    if (not last) then
-      error ('Empty unit')
-    else
-      last.loc =
-        {
-          source = source,
-          line = line,
-        }
-    end
+    self.block:annotate (source, line)
   end
 
   function unit.sequence (self, seq)
     checkArg (0, self, 'SmipsUnit')
     checkArg (1, seq, 'number')
-    local last = self.block:last ()
-
-    if (not last) then
-      error ('Empty unit')
-    else
-      last.seq = seq
-    end
+    self.block:sequence (seq)
   end
 
-  function unit.add_data (self, data, ...)
+  function unit.add_data (self, data, expr, transform)
     checkArg (0, self, 'SmipsUnit')
     checkArg (1, data, 'string', 'number')
+    checkArg (2, expr, 'string', 'nil')
+    checkArg (3, transform, 'string', 'nil')
 
-    if (type (data) == 'number') then
-      local una = data
-      local mis = data % 4
-      local size = mis > 0 and una + (4 - mis) or una
-      self.block:append ({ size = size, extra = {...}, })
+    if (type (data) == 'string') then
+      self.block:data (data)
+    elseif (expr == nil) then
+      self.block:zero (data)
     else
-      self.block:append ({ data = data, extra = {...}, })
+      self.block:delay (data, expr, transform)
     end
   end
 
-  function unit.add_inst (self, inst, ...)
+  -- Moves the location counter forward to 'address', the gap
+  -- is zero filled and its size only known once placed
+  function unit.add_org (self, address)
     checkArg (0, self, 'SmipsUnit')
-    checkArg (1, inst, 'SmipsInst')
+    checkArg (1, address, 'number')
+    self.block:org (address)
+  end
 
-    self.block:append ({
-        size = 4,
-        inst = inst,
-        extra = {...},
-      })
+  -- Instructions come in already encoded, the constant
+  -- field gets patched in place once 'cs' is resolved
+  function unit.add_inst (self, kind, word, cs, style)
+    checkArg (0, self, 'SmipsUnit')
+    checkArg (1, kind, 'string')
+    checkArg (2, word, 'number')
+    self.block:inst (kind, word, cs, style or nil)
   end
 
-  function unit.add_tag (self, tagname)
+  function unit.add_tag (self, tagname, source, line)
     checkArg (0, self, 'SmipsUnit')
     checkArg (1, tagname, 'string')
+    checkArg (2, source, 'string', 'nil')
+    checkArg (3, line, 'number', 'nil')
 
-    if (self.tags [tagname] ~= nil) then
+    if (not self.symbols:define (tagname, self.block:length ())) then
       error (('Redefined tag %s'):format (tagname))
-    else
-      local value = self.block:length ()
-      local tag = tags.rel (value)
-      self.tags [tagname] = tag
+    elseif (source ~= nil) then
+      self.defs [tagname] = { source = source, line = line, }
+    end
+  end
+
+  function unit.new_anon (self)
+    checkArg (0, self, 'SmipsUnit')
+  return self.symbols:anon ()
+  end
+
+  function unit.add_anon (self, id)
+    checkArg (0, self, 'SmipsUnit')
+    checkArg (1, id, 'number')
+
+    if (not self.symbols:define (id, self.block:length ())) then
+      error (('Redefined anonymous tag %i'):format (id))
     end
   end
 
-  function unit.add_local (self, alias, seq, tagname)
+  function unit.add_local (self, alias, seq)
     checkArg (0, self, 'SmipsUnit')
     checkArg (1, alias, 'number')
     checkArg (2, seq, 'number')
-    checkArg (3, tagname, 'string')
     local locals = self.locals
+    local id = self:new_anon ()
 
     if (not locals [alias]) then
       locals [alias] = vector.new ()
     end do
       locals = locals [alias]
-      locals:append ({tagname = tagname, seq = seq, })
-      self:add_tag (tagname)
+      locals:append ({ id = id, seq = seq, })
+      self:add_anon (id)
+    end
+  end
+
+  -- Counts the definitions in 'list' made at or
+  -- before statement 'seq'
+  local function upper (list, seq)
+    local pos, top = 0, list:length ()
+
+    while (pos < top) do
+      local half = math.floor ((pos + top) / 2)
+
+      if (list [half + 1].seq > seq) then
+        top = half
+      else
+        pos = half + 1
+      end
+    end
+  return pos
+  end
+
+  -- Returns a function telling which definition of local tag
+  -- 'alias' a reference made at statement 'seq' means, 'f' looks
+  -- forward and 'b' backwards. References usually come in
+  -- statement order, so a cursor per alias just walks ahead and
+  -- resolving them all is linear; out of order ones bisect
+  function unit.resolver (locals)
+    local cursors = {}
+
+    return function (alias, direction, seq)
+      local list = locals [alias]
+      local cursor = cursors [alias]
+      local pos
+
+      if (list == nil) then
+        return nil
+      elseif (cursor == nil or seq < cursor.seq) then
+        pos = upper (list, seq)
+        cursors [alias] = { seq = seq, pos = pos, }
+      else
+        local next = list [cursor.pos + 1]
+        pos = cursor.pos
+
+        while (next ~= nil and next.seq <= seq) do
+          pos = pos + 1
+          next = list [pos + 1]
+        end
+
+        cursor.seq = seq
+        cursor.pos = pos
+      end
+    return list [(direction == 'f') and pos + 1 or pos]
+    end
+  end
+
+  function unit.concat (self, other)
+    checkArg (0, self, 'SmipsUnit')
+    checkArg (1, other, 'SmipsUnit')
+    local base = self.block:length () - 1
+    local anons = self.symbols:anon (other.symbols:anons ()) - 1
+    local seqs = self.seqs
+
+    -- Entries are copied so 'other' stays untouched by process (),
+    -- operands referencing an anonymous tag by ID get rebased
+    self.block:concat (other.block, anons, seqs)
+
+    for key, value in other.symbols:each () do
+      if (type (key) == 'number') then
+        self.symbols:define (key + anons, value + base)
+      elseif (self.symbols:define (key, value + base)) then
+        self.defs [key] = other.defs [key]
+      else
+        local def = other.defs [key]
+
+        if (not def) then
+          error (('Redefined tag %s'):format (key))
+        else
+          log.error (('%s: %i: Redefined tag \'%s\''):format (def.source, def.line, key))
+        end
+      end
+    end
+
+    for alias, list in pairs (other.locals) do
+      local locals = self.locals [alias]
+
+      if (not locals) then
+        locals = vector.new ()
+        self.locals [alias] = locals
+      end
+
+      for _, loc in list:each () do
+        locals:append ({ id = loc.id + anons, seq = loc.seq + seqs, })
+      end
+    end
+
+    self.seqs = seqs + other.seqs
+  end
+
+  --
+  -- Serialization
+  -- Dumped units are relocatable objects in a data-only format:
+  -- a flat run of '<length>:<bytes>' fields, integers written in
+  -- decimal, read back by a strict cursor which rejects anything
+  -- malformed instead of running it. Operands are not kept as
+  -- source expressions but as fixups, postfix programs over
+  -- constants, symbols, local tag references and the entry's own
+  -- offset ('_'), so linking only replays arithmetic over tags.
+  -- The same format backs the unit cache
+  --
+
+  local magic = 'SMIPS relocatable unit 5\n'
+  local localpattern = '%f[%w_]([0-9]+)([bf])%f[^%w_]'
+  local maxint = 0x7fffffff
+  local invalid = {}
+
+  local opcodes =
+  {
+    const = { args = 1, pops = 0, },
+    string = { args = 1, pops = 0, },
+    symbol = { args = 1, pops = 0, },
+    ['local'] = { args = 2, pops = 0, },
+    here = { args = 0, pops = 0, },
+    unm = { args = 0, pops = 1, },
+    add = { args = 0, pops = 2, },
+    sub = { args = 0, pops = 2, },
+    mul = { args = 0, pops = 2, },
+    div = { args = 0, pops = 2, },
+    idiv = { args = 0, pops = 2, },
+    mod = { args = 0, pops = 2, },
+  }
+
+  -- Operand expressions are evaluated once more over
+  -- symbolic values, which record what is done to them
+  local reloc = {}
+
+  local function node (...)
+  return setmetatable ({ ... }, reloc)
+  end
+
+  for _, op in ipairs ({ 'add', 'sub', 'mul', 'div', 'idiv', 'mod', }) do
+    reloc ['__' .. op] = function (a, b) return node (op, a, b) end
+  end
+
+  reloc.__unm = function (a) return node ('unm', a) end
+
+  local function symbolic ()
+    local env = { tonumber = tonumber, tostring = tostring, _ = node ('here'), }
+
+    env.math = setmetatable ({}, { __mode = 'protected', __index = _G.math, })
+    env.string = setmetatable ({}, { __mode = 'protected', __index = _G.string, })
+
+    function env.__local (alias, direction)
+      return node ('local', alias, direction)
+    end
+  return setmetatable (env, { __index = function (_, key) return node ('symbol', key) end, })
+  end
+
+  local function finite (value)
+  return value == value and value ~= math.huge and value ~= -math.huge
+  end
+
+  local function flatten (prog, value)
+    if (getmetatable (value) == reloc) then
+      local desc = opcodes [value [1]]
+
+      for i = 2, desc.pops + 1 do
+        if (not flatten (prog, value [i])) then
+          return false
+        end
+      end
+
+      prog [#prog + 1] = value [1]
+
+      for i = 2, desc.args + 1 do
+        prog [#prog + 1] = value [i]
+      end
+    elseif (type (value) == 'number' and finite (value)) then
+      prog [#prog + 1] = 'const'
+      prog [#prog + 1] = value
+    elseif (type (value) == 'string') then
+      prog [#prog + 1] = 'string'
+      prog [#prog + 1] = value
+    else
+      return false
+    end
+  return true
+  end
+
+  local function relocate (expr, env)
+    local code = expr:gsub (localpattern, '__local (%1, \'%2\')')
+    local value = exprs.eval (code)
+    local prog = {}
+
+    if (value == nil) then
+      local chunk, reason = load (('do return %s; end'):format (code), '=expression', 't', env)
+      local ok
+
+      if (not chunk) then
+        return nil, reason
+      end
+
+      ok, value = pcall (chunk)
+
+      if (not ok) then
+        return nil, value
+      end
+    end
+
+    if (not flatten (prog, value)) then
+      return nil, 'Value should be constant number'
+    end
+  return prog
+  end
+
+  local function put (out, value)
+    out [#out + 1] = ('%d:%s'):format (#value, value)
+  end
+
+  local function putint (out, value)
+    if (value == math.floor (value) and math.abs (value) < 2^53) then
+      put (out, ('%d'):format (value))
+    else
+      put (out, ('%.17g'):format (value))
+    end
+  end
+
+  local function putprog (out, prog)
+    putint (out, #prog)
+
+    for _, token in ipairs (prog) do
+      if (type (token) == 'number') then
+        putint (out, token)
+      else
+        put (out, token)
+      end
+    end
+  end
+
+  function unit.dump (self)
+    checkArg (0, self, 'SmipsUnit')
+    local block = self.block
+    local env = symbolic ()
+    local progs = {}
+    local out = { magic, }
+
+    local function putoperand (i, operand)
+      local prog, reason = operand, nil
+
+      if (type (operand) == 'string') then
+        prog = progs [operand]
+
+        if (prog == nil) then
+          prog, reason = relocate (operand, env)
+
+          if (prog == nil) then
+            local source, line = block:where (i)
+            return false, ('%s: %i: %s'):format (source or '?', line or -1, reason)
+          end
+
+          progs [operand] = prog
+        end
+      end
+
+      putprog (out, prog)
+    return true
+    end
+
+    putint (out, self.seqs)
+    putint (out, self.symbols:anons ())
+    putint (out, block:length () - 1)
+
+    -- the first entry is the empty head of every block
+    for i = 2, block:length () do
+      local kind, size, operand, style, seq = block:get (i)
+      local source, line = block:where (i)
+      local ok, reason = true
+
+      put (out, kind)
+
+      if (kind == 'data') then
+        put (out, block:bytes (i))
+      elseif (kind == 'zero') then
+        putint (out, size)
+      elseif (kind == 'org') then
+        putint (out, operand)
+      elseif (kind == 'delay') then
+        putint (out, size)
+        put (out, style)
+        ok, reason = putoperand (i, operand)
+      else
+        putint (out, block:word (i))
+        put (out, style or '')
+
+        if (operand == nil) then
+          put (out, 'none')
+        elseif (type (operand) == 'number') then
+          put (out, 'anon')
+          putint (out, operand)
+        else
+          put (out, 'reloc')
+          ok, reason = putoperand (i, operand)
+        end
+      end
+
+      if (not ok) then
+        return nil, reason
+      end
+
+      putint (out, seq or 0)
+      putint (out, line or 0)
+
+      if (line ~= nil) then
+        put (out, source)
+      end
+    end
+
+    local symbols = {}
+
+    for key, value in self.symbols:each () do
+      symbols [#symbols + 1] = { key, value, }
+    end
+
+    putint (out, #symbols)
+
+    for _, symbol in ipairs (symbols) do
+      local key, value = symbol [1], symbol [2]
+      local def = self.defs [key]
+
+      if (type (key) == 'number') then
+        put (out, 'anon')
+        putint (out, key)
+      else
+        put (out, 'name')
+        put (out, key)
+      end
+
+      putint (out, value)
+      putint (out, def and def.line or 0)
+
+      if (def ~= nil) then
+        put (out, def.source)
+      end
+    end
+
+    local aliases = {}
+
+    for alias in pairs (self.locals) do
+      aliases [#aliases + 1] = alias
+    end
+
+    table.sort (aliases)
+    putint (out, #aliases)
+
+    for _, alias in ipairs (aliases) do
+      local locals = self.locals [alias]
+
+      putint (out, alias)
+      putint (out, locals:length ())
+
+      for _, loc in locals:each () do
+        putint (out, loc.id)
+        putint (out, loc.seq)
+      end
+    end
+  return table.concat (out)
+  end
+
+  -- Every read either consumes input or throws 'invalid',
+  -- so no object makes the reader loop for longer than its size
+  local function reader (data)
+    local rd = { pos = #magic + 1, }
+
+    function rd.field ()
+      local _, stop, length = data:find ('^(%d%d?%d?%d?%d?%d?%d?%d?%d?):', rd.pos)
+
+      if (stop == nil or stop + length > #data) then
+        error (invalid, 0)
+      end
+
+      rd.pos = stop + length + 1
+    return data:sub (stop + 1, stop + length)
+    end
+
+    function rd.number ()
+      local value = rd.field ()
+
+      if (not value:match ('^%-?[0-9][0-9.eE+%-]*$')) then
+        error (invalid, 0)
+      end
+
+      value = tonumber (value)
+
+      if (value == nil or not finite (value)) then
+        error (invalid, 0)
+      end
+    return value
+    end
+
+    function rd.integer (min, max)
+      local value = rd.field ()
+
+      if (not value:match ('^%-?%d%d?%d?%d?%d?%d?%d?%d?%d?%d?%d?%d?%d?%d?%d?$')) then
+        error (invalid, 0)
+      end
+
+      value = tonumber (value)
+
+      if (value < min or value > max) then
+        error (invalid, 0)
+      end
+    return value
+    end
+
+    function rd.check (condition)
+      if (not condition) then
+        error (invalid, 0)
+      end
+    end
+  return rd
+  end
+
+  local function readprog (rd, size)
+    local left = rd.integer (1, size)
+    local prog = {}
+    local depth = 0
+
+    -- 'left' counts fields, operators and their arguments alike
+    while (left > 0) do
+      local op = rd.field ()
+      local desc = opcodes [op]
+
+      rd.check (desc ~= nil and depth >= desc.pops)
+      prog [#prog + 1] = op
+      depth = depth - desc.pops + 1
+      left = left - 1 - desc.args
+
+      if (op == 'const') then
+        prog [#prog + 1] = rd.number ()
+      elseif (op == 'string' or op == 'symbol') then
+        prog [#prog + 1] = rd.field ()
+      elseif (op == 'local') then
+        prog [#prog + 1] = rd.integer (0, maxint)
+        prog [#prog + 1] = rd.field ()
+        rd.check (prog [#prog] == 'b' or prog [#prog] == 'f')
+      end
+    end
+
+    rd.check (left == 0 and depth == 1)
+  return prog
+  end
+
+  local function readent (rd, block, anons, size)
+    local kind = rd.field ()
+
+    if (kind == 'data') then
+      block:data (rd.field ())
+    elseif (kind == 'zero') then
+      block:zero (rd.integer (0, maxint - 3))
+    elseif (kind == 'org') then
+      local address = rd.integer (0, 0xfffffffc)
+      rd.check (address % 4 == 0)
+      block:org (address)
+    elseif (kind == 'delay') then
+      local length = rd.integer (0, maxint - 3)
+      local transform = rd.field ()
+
+      rd.check (isa.transforms [transform] ~= nil)
+      block:delay (length, readprog (rd, size), transform)
+    elseif (kind == 'r' or kind == 'i' or kind == 'j') then
+      local word = rd.integer (0, 0xffffffff)
+      local style = rd.field ()
+      local tag = rd.field ()
+      local operand
+
+      rd.check (style:match ('^[a-z]?$') ~= nil)
+
+      if (tag == 'anon') then
+        operand = rd.integer (1, anons)
+      elseif (tag == 'reloc') then
+        operand = readprog (rd, size)
+      else
+        rd.check (tag == 'none')
+      end
+
+      block:inst (kind, word, operand, style ~= '' and style or nil)
+    else
+      rd.check (false)
+    end
+
+    local seq = rd.integer (0, maxint)
+    local line = rd.integer (0, maxint)
+
+    if (seq > 0) then
+      block:sequence (seq)
+    end
+
+    if (line > 0) then
+      block:annotate (rd.field (), line)
+    end
+  end
+
+  local function parse (data)
+    local rd = reader (data)
+    local self = unit.new ()
+    local size = #data
+    local anons
+
+    self.seqs = rd.integer (0, maxint)
+    anons = rd.integer (0, size)
+    self.symbols:anon (anons)
+
+    for _ = 1, rd.integer (0, size) do
+      readent (rd, self.block, anons, size)
+    end
+
+    for _ = 1, rd.integer (0, size) do
+      local tag = rd.field ()
+      local key, value, line
+
+      if (tag == 'anon') then
+        key = rd.integer (1, anons)
+      else
+        rd.check (tag == 'name')
+        key = rd.field ()
+      end
+
+      value = rd.integer (1, self.block:length ())
+      line = rd.integer (0, maxint)
+      rd.check (self.symbols:define (key, value))
+
+      if (line > 0) then
+        self.defs [key] = { source = rd.field (), line = line, }
+      end
+    end
+
+    for _ = 1, rd.integer (0, size) do
+      local alias = rd.integer (0, maxint)
+      local locals = vector.new ()
+
+      rd.check (self.locals [alias] == nil)
+      self.locals [alias] = locals
+
+      for _ = 1, rd.integer (0, size) do
+        local id = rd.integer (1, anons)
+        locals:append ({ id = id, seq = rd.integer (0, maxint), })
+      end
+    end
+
+    rd.check (rd.pos == size + 1)
+  return self
+  end
+
+  function unit.undump (data)
+    checkArg (1, data, 'string')
+
+    if (data:sub (1, #magic) ~= magic) then
+      return nil
+    else
+      local ok, self = pcall (parse, data)
+
+      if (ok) then
+        return self
+      elseif (self == invalid) then
+        return nil
+      else
+        error (self, 0)
+      end
     end
   end
 return unit
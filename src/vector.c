@@ -0,0 +1,266 @@
+/* Copyright 2021-2025 MarcosHCK
+ * This file is part of SMIPS Assembler.
+ *
+ * SMIPS Assembler is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SMIPS Assembler is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with SMIPS Assembler. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <config.h>
+#include <gmodule.h>
+#include <lua.h>
+#include <lauxlib.h>
+#include <luacmpt.h>
+
+typedef struct _SmipsVector SmipsVector;
+#define META "SmipsVector"
+
+#if LUA_VERSION_NUM >= 502
+# define getuservalue(L,idx) lua_getuservalue ((L), (idx))
+# define setuservalue(L,idx) lua_setuservalue ((L), (idx))
+#else // LUA_VERSION_NUM < 502
+# define getuservalue(L,idx) lua_getfenv ((L), (idx))
+# define setuservalue(L,idx) lua_setfenv ((L), (idx))
+#endif // LUA_VERSION_NUM
+
+/*
+ * Elements live in the array part of the vector's user
+ * value, the length is kept here so it is never computed
+ *
+ */
+
+struct _SmipsVector
+{
+  lua_Integer length;
+};
+
+static SmipsVector* checkvector (lua_State* L, int idx)
+{
+return luaL_checkudata (L, idx, META);
+}
+
+static int _new (lua_State* L)
+{
+  const lua_Integer reserve = luaL_optinteger (L, 1, 0);
+  SmipsVector* self = lua_newuserdata (L, sizeof (SmipsVector));
+
+#if LUA_VERSION_NUM >= 502
+  luaL_setmetatable (L, META);
+#else // LUA_VERSION_NUM < 502
+  lua_getfield (L, LUA_REGISTRYINDEX, META);
+  lua_setmetatable (L, -2);
+#endif // LUA_VERSION_NUM
+
+  self->length = 0;
+  lua_createtable (L, (int) MAX (reserve, 0), 0);
+  setuservalue (L, -2);
+return 1;
+}
+
+static int __index (lua_State* L)
+{
+  SmipsVector* self = checkvector (L, 1);
+
+  if (lua_type (L, 2) != LUA_TNUMBER)
+    lua_getfield (L, lua_upvalueindex (1), luaL_checkstring (L, 2));
+  else
+  {
+    const lua_Integer i = lua_tointeger (L, 2);
+
+    if (i < 1 || i > self->length)
+      lua_pushnil (L);
+    else
+    {
+      getuservalue (L, 1);
+      lua_rawgeti (L, -1, i);
+    }
+  }
+return 1;
+}
+
+static int length (lua_State* L)
+{
+  SmipsVector* self = checkvector (L, 1);
+return (lua_pushinteger (L, self->length), 1);
+}
+
+static int append (lua_State* L)
+{
+  SmipsVector* self = checkvector (L, 1);
+
+  luaL_checkany (L, 2);
+  lua_settop (L, 2);
+  getuservalue (L, 1);
+  lua_pushvalue (L, 2);
+  lua_rawseti (L, 3, ++self->length);
+  lua_settop (L, 2);
+return 1;
+}
+
+static int prepend (lua_State* L)
+{
+  SmipsVector* self = checkvector (L, 1);
+  lua_Integer i;
+
+  luaL_checkany (L, 2);
+  lua_settop (L, 2);
+  getuservalue (L, 1);
+
+  for (i = self->length; i > 0; i--)
+  {
+    lua_rawgeti (L, 3, i);
+    lua_rawseti (L, 3, i + 1);
+  }
+
+  lua_pushvalue (L, 2);
+  lua_rawseti (L, 3, 1);
+  self->length++;
+  lua_settop (L, 2);
+return 1;
+}
+
+static int last (lua_State* L)
+{
+  SmipsVector* self = checkvector (L, 1);
+
+  if (self->length == 0)
+    lua_pushnil (L);
+  else
+  {
+    getuservalue (L, 1);
+    lua_rawgeti (L, -1, self->length);
+  }
+return 1;
+}
+
+static int reserve (lua_State* L)
+{
+  SmipsVector* self = checkvector (L, 1);
+  const lua_Integer size = luaL_checkinteger (L, 2);
+  lua_Integer i;
+
+  if (size > self->length)
+  {
+    /* rebuild the backing table with a presized array part */
+    lua_createtable (L, (int) size, 0);
+    getuservalue (L, 1);
+
+    for (i = 1; i <= self->length; i++)
+    {
+      lua_rawgeti (L, -1, i);
+      lua_rawseti (L, -3, i);
+    }
+
+    lua_pop (L, 1);
+    setuservalue (L, 1);
+  }
+return 0;
+}
+
+static int extend (lua_State* L)
+{
+  SmipsVector* self = checkvector (L, 1);
+  SmipsVector* other = NULL;
+  lua_Integer i, count;
+
+  lua_settop (L, 2);
+  getuservalue (L, 1);
+
+  if (luaL_testudata (L, 2, META))
+  {
+    other = lua_touserdata (L, 2);
+    count = other->length;
+    getuservalue (L, 2);
+  }
+  else
+  {
+    luaL_checktype (L, 2, LUA_TTABLE);
+#if LUA_VERSION_NUM >= 502
+    count = (lua_Integer) lua_rawlen (L, 2);
+#else // LUA_VERSION_NUM < 502
+    count = (lua_Integer) lua_objlen (L, 2);
+#endif // LUA_VERSION_NUM
+    lua_pushvalue (L, 2);
+  }
+
+  for (i = 1; i <= count; i++)
+  {
+    lua_rawgeti (L, 4, i);
+    lua_rawseti (L, 3, self->length + i);
+  }
+
+  self->length += count;
+return 0;
+}
+
+static int iter (lua_State* L)
+{
+  SmipsVector* self = checkvector (L, 1);
+  const lua_Integer i = luaL_checkinteger (L, 2) + 1;
+
+  if (i > self->length)
+    return 0;
+
+  lua_pushinteger (L, i);
+  getuservalue (L, 1);
+  lua_rawgeti (L, -1, i);
+  lua_remove (L, -2);
+return 2;
+}
+
+static int each (lua_State* L)
+{
+  checkvector (L, 1);
+  lua_pushcfunction (L, iter);
+  lua_pushvalue (L, 1);
+  lua_pushinteger (L, 0);
+return 3;
+}
+
+G_MODULE_EXPORT
+int luaopen_vector (lua_State* L)
+{
+  lua_createtable (L, 0, 8);
+  luaL_newmetatable (L, META);
+#if LUA_VERSION_NUM < 503
+  lua_pushliteral (L, META);
+  lua_setfield (L, -2, "__name");
+#endif // LUA_VERSION_NUM
+  lua_pushvalue (L, -2);
+  lua_pushcclosure (L, __index, 1);
+  lua_setfield (L, -2, "__index");
+  lua_pushcfunction (L, length);
+  lua_setfield (L, -2, "__len");
+#if LUA_VERSION_NUM == 502
+  lua_pushcfunction (L, each);
+  lua_setfield (L, -2, "__ipairs");
+#endif // LUA_VERSION_NUM
+  lua_pop (L, 1);
+
+  lua_pushcfunction (L, _new);
+  lua_setfield (L, -2, "new");
+  lua_pushcfunction (L, length);
+  lua_setfield (L, -2, "length");
+  lua_pushcfunction (L, append);
+  lua_setfield (L, -2, "append");
+  lua_pushcfunction (L, prepend);
+  lua_setfield (L, -2, "prepend");
+  lua_pushcfunction (L, last);
+  lua_setfield (L, -2, "last");
+  lua_pushcfunction (L, reserve);
+  lua_setfield (L, -2, "reserve");
+  lua_pushcfunction (L, extend);
+  lua_setfield (L, -2, "extend");
+  lua_pushcfunction (L, each);
+  lua_setfield (L, -2, "each");
+return 1;
+}
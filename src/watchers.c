@@ -0,0 +1,166 @@
+/* Copyright 2021-2025 MarcosHCK
+ * This file is part of SMIPS Assembler.
+ *
+ * SMIPS Assembler is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SMIPS Assembler is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with SMIPS Assembler. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <config.h>
+#include <gio/gio.h>
+#include <gmodule.h>
+#include <lua.h>
+#include <lauxlib.h>
+#include <luacmpt.h>
+#include <log.h>
+
+typedef struct _SmipsWatcher SmipsWatcher;
+#define META "SmipsWatcher"
+
+struct _SmipsWatcher
+{
+  GMainContext* context;
+  GPtrArray* monitors;
+  gboolean* dirty;
+  guint count;
+};
+
+static void on_changed (GFileMonitor* monitor, GFile* file, GFile* other, GFileMonitorEvent event, gpointer user_data)
+{
+  gboolean* dirty = user_data;
+
+  switch (event)
+  {
+    case G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT:
+    case G_FILE_MONITOR_EVENT_CREATED:
+    case G_FILE_MONITOR_EVENT_MOVED_IN:
+    case G_FILE_MONITOR_EVENT_RENAMED:
+      *dirty = TRUE;
+      break;
+    default:
+      break;
+  }
+}
+
+static int __gc (lua_State* L)
+{
+  SmipsWatcher* self = luaL_checkudata (L, 1, META);
+  g_clear_pointer (&self->monitors, g_ptr_array_unref);
+  g_clear_pointer (&self->context, g_main_context_unref);
+  g_clear_pointer (&self->dirty, g_free);
+return 0;
+}
+
+static int _new (lua_State* L)
+{
+  const gsize sz = sizeof (SmipsWatcher);
+  SmipsWatcher* self = NULL;
+  GFileMonitor* monitor = NULL;
+  GError* tmperr = NULL;
+  const gchar* path = NULL;
+  GFile* file = NULL;
+  guint i;
+
+  luaL_checktype (L, 1, LUA_TTABLE);
+  self = lua_newuserdata (L, sz);
+  memset (self, 0, sz);
+#if LUA_VERSION_NUM >= 502
+  luaL_setmetatable (L, META);
+#else // LUA_VERSION_NUM < 502
+  lua_getfield (L, LUA_REGISTRYINDEX, META);
+  lua_setmetatable (L, -2);
+#endif // LUA_VERSION_NUM
+
+#if LUA_VERSION_NUM >= 502
+  self->count = (guint) lua_rawlen (L, 1);
+#else // LUA_VERSION_NUM < 502
+  self->count = (guint) lua_objlen (L, 1);
+#endif // LUA_VERSION_NUM
+  self->context = g_main_context_new ();
+  self->monitors = g_ptr_array_new_with_free_func (g_object_unref);
+  self->dirty = g_new0 (gboolean, self->count);
+
+  for (i = 0; i < self->count; i++)
+  {
+    lua_rawgeti (L, 1, i + 1);
+
+    if ((path = lua_tostring (L, -1)) == NULL)
+      luaL_argerror (L, 1, "expected a list of file names");
+    if (strcmp (path, "-") == 0)
+      _smips_log_lerror (L, 1, "Can not watch standard input");
+
+    g_main_context_push_thread_default (self->context);
+    file = g_file_new_for_commandline_arg (path);
+    monitor = g_file_monitor_file (file, G_FILE_MONITOR_WATCH_MOVES, NULL, &tmperr);
+    g_main_context_pop_thread_default (self->context);
+    g_object_unref (file);
+
+    if (G_UNLIKELY (tmperr != NULL))
+      _smips_log_gerror (L, 1, tmperr);
+
+    g_signal_connect (monitor, "changed", G_CALLBACK (on_changed), & self->dirty [i]);
+    g_ptr_array_add (self->monitors, monitor);
+    lua_pop (L, 1);
+  }
+return 1;
+}
+
+static int wait (lua_State* L)
+{
+  SmipsWatcher* self = luaL_checkudata (L, 1, META);
+  gboolean any = FALSE;
+  guint i, n = 0;
+
+  while (!any)
+  {
+    g_main_context_iteration (self->context, TRUE);
+
+    for (i = 0; i < self->count && !any; i++)
+      any = self->dirty [i];
+  }
+
+  while (g_main_context_iteration (self->context, FALSE));
+  lua_createtable (L, self->count, 0);
+
+  for (i = 0; i < self->count; i++)
+  {
+    if (self->dirty [i])
+    {
+      self->dirty [i] = FALSE;
+      lua_pushinteger (L, i + 1);
+      lua_rawseti (L, -2, ++n);
+    }
+  }
+return 1;
+}
+
+G_MODULE_EXPORT
+int luaopen_watchers (lua_State* L)
+{
+  lua_createtable (L, 0, 2);
+  luaL_newmetatable (L, META);
+#if LUA_VERSION_NUM < 503
+  lua_pushliteral (L, META);
+  lua_setfield (L, -2, "__name");
+#endif // LUA_VERSION_NUM
+  lua_pushcfunction (L, __gc);
+  lua_setfield (L, -2, "__gc");
+  lua_pushvalue (L, -2);
+  lua_setfield (L, -2, "__index");
+  lua_pop (L, 1);
+
+  lua_pushcfunction (L, _new);
+  lua_setfield (L, -2, "new");
+  lua_pushcfunction (L, wait);
+  lua_setfield (L, -2, "wait");
+return 1;
+}